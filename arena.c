@@ -0,0 +1,110 @@
+// arena.c ... arena (region) allocators
+// part of Multi-attribute Linear-hashed Files
+// An Arena hands out memory from large blocks, for things that all
+//   live as long as some operation (a query, an inserted tuple);
+//   none of it is freed individually: resetting the arena releases
+//   everything allocated since the last reset, at once
+// The first block is kept across resets, so an arena that's reset
+//   after each small operation never calls malloc again
+
+#include "defs.h"
+#include "arena.h"
+
+#define BLOCKSIZE 8192
+#define ALIGN     8
+
+typedef struct Block {
+	struct Block *next;  // block allocated before this one
+	Count size;          // bytes in data[]
+	Count used;          // bytes handed out
+	char  data[];
+} Block;
+
+struct ArenaRep {
+	Block *cur;    // block being allocated from (most recent)
+	Block *first;  // block kept across resets
+	void  *last;   // most recent allocation (see arenaGrow)
+};
+
+static Block *newBlock(Count size, Block *next)
+{
+	Block *b = malloc(sizeof(Block) + size);
+	assert(b != NULL);
+	b->next = next;
+	b->size = size;
+	b->used = 0;
+	return b;
+}
+
+// an empty arena
+
+Arena newArena(void)
+{
+	Arena a = malloc(sizeof(struct ArenaRep));
+	assert(a != NULL);
+	a->first = a->cur = newBlock(BLOCKSIZE, NULL);
+	a->last = NULL;
+	return a;
+}
+
+// n bytes from an arena, aligned for any type
+
+void *arenaAlloc(Arena a, Count n)
+{
+	n = (n + ALIGN-1) & ~(ALIGN-1);
+	Block *b = a->cur;
+	if (b->size - b->used < n) {
+		b = a->cur = newBlock(n > BLOCKSIZE ? n : BLOCKSIZE, b);
+	}
+	void *p = b->data + b->used;
+	b->used += n;
+	a->last = p;
+	return p;
+}
+
+// grow an allocation of oldn bytes to n bytes (like realloc)
+// the most recent allocation grows in place if there's room
+
+void *arenaGrow(Arena a, void *old, Count oldn, Count n)
+{
+	Block *b = a->cur;
+	Count nn = (n + ALIGN-1) & ~(ALIGN-1);
+	if (old != NULL && old == a->last &&
+	    (char *)old + nn <= b->data + b->size) {
+		b->used = (char *)old - b->data + nn;
+		return old;
+	}
+	void *p = arenaAlloc(a, n);
+	if (old != NULL) memcpy(p, old, oldn < n ? oldn : n);
+	return p;
+}
+
+// a copy of a string, in an arena
+
+char *arenaString(Arena a, char *s)
+{
+	Count n = strlen(s)+1;
+	char *c = arenaAlloc(a, n);
+	memcpy(c, s, n);
+	return c;
+}
+
+// release everything allocated from an arena
+
+void resetArena(Arena a)
+{
+	while (a->cur != a->first) {
+		Block *b = a->cur;
+		a->cur = b->next;
+		free(b);
+	}
+	a->cur->used = 0;
+	a->last = NULL;
+}
+
+void freeArena(Arena a)
+{
+	resetArena(a);
+	free(a->first);
+	free(a);
+}
@@ -0,0 +1,19 @@
+// arena.h ... interface to arena allocators
+// part of Multi-attribute Linear-hashed Files
+// See arena.c for details of Arena type and functions
+
+#ifndef ARENA_H
+#define ARENA_H 1
+
+typedef struct ArenaRep *Arena;
+
+#include "defs.h"
+
+Arena newArena(void);
+void *arenaAlloc(Arena a, Count n);
+void *arenaGrow(Arena a, void *old, Count oldn, Count n);
+char *arenaString(Arena a, char *s);
+void resetArena(Arena a);
+void freeArena(Arena a);
+
+#endif
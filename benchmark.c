@@ -0,0 +1,329 @@
+// benchmark.c ... measure insert, split and query performance
+// part of Multi-attribute linear-hashed files
+// Builds a relation from a generated workload, then times
+//   - inserting the tuples (tuples/sec, including the splits they cause)
+//   - point queries, with every attribute known (latency percentiles)
+//   - partial-match queries, for a set of query patterns (throughput)
+//   - splitting a quarter of the buckets (cost per split)
+// and appends the results, as one line of JSON, to a results file,
+//   so that runs can be compared
+// Usage:  ./benchmark  [-v]  [-z]  [-P]  [-k]  [-n #tuples]  [-a #attrs]
+//                      [-d domain]  [-q #queries]  [-m #scans]  [-s seed]
+//                      [-o results]
+// -n #tuples = size of relation (default 100000, up to 10^8)
+// -a #attrs = attributes per tuple (2..10, default 3); attribute 0
+//             is a unique id, the others are drawn from a domain
+// -d domain = number of distinct values of the other attributes
+//             (default 1000)
+// -k = skewed (Zipf) values rather than uniform ones
+// -q #queries = point queries (default 1000)
+// -m #scans = partial-match queries per pattern (default 20)
+// -o results = file to append results to (default bench.json)
+// -z, -P = create the relation compressed, or with PAX pages
+// The relation (Bench.*) is removed afterwards
+
+#include "defs.h"
+#include "reln.h"
+#include "query.h"
+#include "page.h"
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+
+#define USAGE "./benchmark  [-v]  [-z]  [-P]  [-k]  [-n #tuples]  [-a #attrs]  [-d domain]  [-q #queries]  [-m #scans]  [-s seed]  [-o results]"
+#define RELNAME "Bench"
+
+static int natts;        // attributes per tuple
+static Count domain;     // distinct values of attributes 1..natts-1
+static double *zipf;     // skewed: cumulative distribution (else NULL)
+static unsigned long long seed;
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+// a well-mixed 64-bit value from x (splitmix64)
+
+static unsigned long long mix(unsigned long long x)
+{
+	x += 0x9e3779b97f4a7c15ULL;
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+	return x ^ (x >> 31);
+}
+
+// value index of attribute j (> 0) of tuple i
+// tuples are a function of i, so any of them can be made again later
+
+static Count valueOf(Count i, int j)
+{
+	unsigned long long x = mix(seed ^ ((unsigned long long)i*MAXATTRS + j));
+	if (zipf == NULL) return x % domain;
+	double u = (x >> 11) * (1.0/9007199254740992.0);
+	Count lo = 0, hi = domain-1;
+	while (lo < hi) {
+		Count mid = (lo+hi)/2;
+		if (zipf[mid] < u) lo = mid+1; else hi = mid;
+	}
+	return lo;
+}
+
+// printable value of attribute j of tuple i
+
+static void attrString(Count i, int j, char *buf)
+{
+	if (j == 0)
+		sprintf(buf, "%u", i+1);
+	else
+		sprintf(buf, "v%u", valueOf(i,j));
+}
+
+// tuple i, with the attributes in mask (bit j => attribute j) given
+//   and the others '?'
+
+static void makeTuple(Count i, unsigned mask, char *buf)
+{
+	char *c = buf;
+	for (int j = 0; j < natts; j++) {
+		if (j > 0) *c++ = ',';
+		if (mask & (1u << j))
+			attrString(i, j, c);
+		else
+			strcpy(c, "?");
+		c += strlen(c);
+	}
+}
+
+static int cmpDouble(const void *a, const void *b)
+{
+	double x = *(double *)a, y = *(double *)b;
+	return (x > y) - (x < y);
+}
+
+// pages read so far, from both of a relation's files
+
+static Count pagesRead(Reln r)
+{
+	Count dr, dw, da, or, ow, oa;
+	fileCounts(dataFile(r), &dr, &dw, &da);
+	fileCounts(ovflowFile(r), &or, &ow, &oa);
+	return dr + or;
+}
+
+static void removeRelation(void)
+{
+	char *suffix[] = { "info", "data", "ovflow", "data.map", "ovflow.map",
+	                   "dict", "heap", "sum", "sketch" };
+	char fname[MAXFILENAME];
+	for (int i = 0; i < 9; i++) {
+		sprintf(fname, "%s.%s", RELNAME, suffix[i]);
+		unlink(fname);
+	}
+}
+
+// Main ... process args, build relation, run workloads
+
+int main(int argc, char **argv)
+{
+	Reln r;  // handle on the benchmark relation
+	char err[MAXERRMSG];  // buffer for error messages
+	int verbose = 0;  // show progress
+	long long ntups = 100000;  // tuples in relation
+	int nqueries = 1000;  // point queries
+	int nscans = 20;  // partial-match queries per pattern
+	int skewed = 0;  // Zipf values?
+	Count flags = 0;  // relation options
+	char *results = "bench.json";  // where results go
+	int opt;
+
+	// process command-line args
+
+	natts = 3; domain = 1000; seed = 1;
+	while ((opt = getopt(argc, argv, "+vzPkn:a:d:q:m:s:o:")) != -1) {
+		switch (opt) {
+		case 'v': verbose = 1; break;
+		case 'z': flags |= RELN_COMPRESSED; break;
+		case 'P': flags |= RELN_PAX; break;
+		case 'k': skewed = 1; break;
+		case 'n': ntups = atoll(optarg); break;
+		case 'a': natts = atoi(optarg); break;
+		case 'd': domain = atoi(optarg); break;
+		case 'q': nqueries = atoi(optarg); break;
+		case 'm': nscans = atoi(optarg); break;
+		case 's': seed = atoll(optarg); break;
+		case 'o': results = optarg; break;
+		default:  fatal(USAGE);
+		}
+	}
+	if (ntups < 1 || ntups > 100000000) {
+		sprintf(err, "Invalid #tuples: %lld (must be 0 < # <= 10^8)", ntups);
+		fatal(err);
+	}
+	if (natts < 2 || natts > 10) {
+		sprintf(err, "Invalid #attrs: %d (must be 1 < # < 11)", natts);
+		fatal(err);
+	}
+	if (domain < 1 || nqueries < 1 || nscans < 1) fatal(USAGE);
+
+	// skewed values: P(value k) is proportional to 1/(k+1)
+	zipf = NULL;
+	if (skewed) {
+		zipf = malloc(domain*sizeof(double));
+		assert(zipf != NULL);
+		double sum = 0;
+		for (Count k = 0; k < domain; k++) sum += 1.0/(k+1);
+		double cum = 0;
+		for (Count k = 0; k < domain; k++) {
+			cum += 1.0/(k+1)/sum;
+			zipf[k] = cum;
+		}
+		zipf[domain-1] = 1.0;
+	}
+
+	// build the relation
+
+	removeRelation();
+	if (newRelation(RELNAME, natts, 1, 0, "", NULL, flags, NO_KEY) != OK)
+		fatal("Can't create benchmark relation");
+	r = openRelation(RELNAME, "r+");
+	assert(r != NULL);
+	// inserts show each tuple's hash on stdout, as insert does;
+	// it's discarded while loading
+	fflush(stdout);
+	int saved = dup(1), null = open("/dev/null", O_WRONLY);
+	assert(saved >= 0 && null >= 0);
+	dup2(null, 1);
+	char tup[MAXLINE];
+	double t0 = now();
+	for (Count i = 0; i < ntups; i++) {
+		makeTuple(i, ~0u, tup);
+		if (addToRelation(r, tup) == NO_PAGE) fatal("Insert failed");
+		if (verbose && (i+1) % 1000000 == 0)
+			fprintf(stderr, "%u tuples inserted\n", i+1);
+	}
+	double tinsert = now() - t0;
+	fflush(stdout);
+	dup2(saved, 1);
+	close(saved); close(null);
+	Count splits = relnCounted(r, CNT_SPLIT);
+
+	// point queries: latency of looking up existing tuples
+
+	double *lat = malloc(nqueries*sizeof(double));
+	assert(lat != NULL);
+	Count found = 0;
+	for (int k = 0; k < nqueries; k++) {
+		makeTuple(mix(seed+k) % ntups, ~0u, tup);
+		t0 = now();
+		Query q = startQuery(r, tup);
+		TupleView v;
+		while (getNextView(q, &v)) found++;
+		closeQuery(q);
+		lat[k] = now() - t0;
+	}
+	qsort(lat, nqueries, sizeof(double), cmpDouble);
+	if (found != nqueries) {
+		sprintf(err, "Point queries found %u of %d tuples", found, nqueries);
+		fatal(err);
+	}
+
+	// partial-match queries: each attribute known alone, the first two
+	//   known together, all but the id known, and none known (a scan
+	//   of the whole relation, done once)
+
+	unsigned masks[MAXATTRS+3];
+	int npatterns = 0;
+	for (int j = 0; j < natts; j++) masks[npatterns++] = 1u << j;
+	if (natts > 2) masks[npatterns++] = 3;
+	masks[npatterns++] = ((1u << natts) - 1) & ~1u;
+	masks[npatterns++] = 0;
+	FILE *devnull = fopen("/dev/null", "w");
+	assert(devnull != NULL);
+	double scansecs[MAXATTRS+3];
+	Count matched[MAXATTRS+3], pages[MAXATTRS+3], nq[MAXATTRS+3];
+	for (int p = 0; p < npatterns; p++) {
+		nq[p] = (masks[p] == 0) ? 1 : nscans;
+		matched[p] = 0;
+		Count before = pagesRead(r);
+		t0 = now();
+		for (int k = 0; k < nq[p]; k++) {
+			makeTuple(mix(seed+nqueries+k) % ntups, masks[p], tup);
+			Query q = startQuery(r, tup);
+			matched[p] += writeQuery(q, NULL, 0, devnull);
+			closeQuery(q);
+		}
+		scansecs[p] = now() - t0;
+		pages[p] = pagesRead(r) - before;
+	}
+	fclose(devnull);
+
+	// split cost: split a quarter of the buckets in one go
+
+	Count nsplit = (npages(r) + 3) / 4;
+	Count moved = relnCounted(r, CNT_MOVED);
+	t0 = now();
+	expandRelation(r, nsplit);
+	double tsplit = now() - t0;
+	moved = relnCounted(r, CNT_MOVED) - moved;
+	Count finalpages = npages(r);
+	closeRelation(r);
+	removeRelation();
+
+	// report: one line of JSON appended to results, and text on stdout
+
+	FILE *out = fopen(results, "a");
+	if (out == NULL) {
+		sprintf(err, "Can't open results file: %.100s", results);
+		fatal(err);
+	}
+	fprintf(out, "{\"time\":%lld,\"tuples\":%lld,\"attrs\":%d,"
+	        "\"domain\":%u,\"dist\":\"%s\",\"compressed\":%d,\"pax\":%d,"
+	        "\"insert\":{\"secs\":%.3f,\"tuples_per_sec\":%.0f,\"splits\":%u},"
+	        "\"point\":{\"queries\":%d,\"p50_us\":%.1f,\"p90_us\":%.1f,"
+	        "\"p99_us\":%.1f,\"max_us\":%.1f},",
+	        (long long)time(NULL), ntups, natts, domain,
+	        skewed ? "zipf" : "uniform", (flags & RELN_COMPRESSED) != 0,
+	        (flags & RELN_PAX) != 0, tinsert, ntups/tinsert, splits,
+	        nqueries, 1e6*lat[nqueries/2], 1e6*lat[nqueries*9/10],
+	        1e6*lat[nqueries*99/100], 1e6*lat[nqueries-1]);
+	fprintf(out, "\"scan\":[");
+	for (int p = 0; p < npatterns; p++) {
+		makeTuple(0, 0, tup);
+		for (int j = 0; j < natts; j++)
+			if (masks[p] & (1u << j)) tup[2*j] = 'v';
+		fprintf(out, "%s{\"pattern\":\"%s\",\"queries\":%u,\"matched\":%u,"
+		        "\"pages\":%u,\"ms_per_query\":%.3f,\"tuples_per_sec\":%.0f,"
+		        "\"pages_per_sec\":%.0f}",
+		        (p > 0) ? "," : "", tup, nq[p], matched[p], pages[p],
+		        1e3*scansecs[p]/nq[p], matched[p]/scansecs[p],
+		        pages[p]/scansecs[p]);
+	}
+	fprintf(out, "],\"split\":{\"splits\":%u,\"secs\":%.3f,"
+	        "\"ms_per_split\":%.3f,\"moved_per_split\":%.1f,\"pages\":%u}}\n",
+	        nsplit, tsplit, 1e3*tsplit/nsplit, (double)moved/nsplit,
+	        finalpages);
+	fclose(out);
+
+	printf("Insert: %lld tuples in %.3fs (%.0f tuples/sec, %u splits)\n",
+	       ntups, tinsert, ntups/tinsert, splits);
+	printf("Point queries: p50 %.1fus  p90 %.1fus  p99 %.1fus  max %.1fus\n",
+	       1e6*lat[nqueries/2], 1e6*lat[nqueries*9/10],
+	       1e6*lat[nqueries*99/100], 1e6*lat[nqueries-1]);
+	for (int p = 0; p < npatterns; p++) {
+		makeTuple(0, 0, tup);
+		for (int j = 0; j < natts; j++)
+			if (masks[p] & (1u << j)) tup[2*j] = 'v';
+		printf("Scan %-20s %.3fms/query  %.0f tuples/sec  %.0f pages/sec\n",
+		       tup, 1e3*scansecs[p]/nq[p], matched[p]/scansecs[p],
+		       pages[p]/scansecs[p]);
+	}
+	printf("Split: %u buckets in %.3fs (%.3fms each, %.1f tuples moved)\n",
+	       nsplit, tsplit, 1e3*tsplit/nsplit, (double)moved/nsplit);
+	printf("Results appended to %s\n", results);
+	free(lat);
+	free(zipf);
+	return 0;
+}
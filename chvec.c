@@ -7,11 +7,20 @@
 #include "defs.h"
 #include "reln.h"
 #include "chvec.h"
+#include <math.h>
+#include <limits.h>
+
+// a hash bit is skewed if it's set in fewer than 35% or more than 65%
+//   of an attribute's values
+#define SKEW 0.15
 
 // convert a a,b:a,b:a,b:...:a,b" representation
 //  of a choice vector into a ChVec
 // if string doesn't specify all 32 bits, then
 //  cycle through attributes until reach 32 bits
+// in a relation with a key attribute, the rest of the bits all come
+//  from the key, so that (unless the string says otherwise) a key
+//  value always hashes to a single bucket
 
 Status parseChVec(Reln r, char *str, ChVec cv)
 {
@@ -47,6 +56,19 @@ Status parseChVec(Reln r, char *str, ChVec cv)
 	//   so as to hopefully not conflict 
 	Count x;  Count next[MAXCHVEC];
 	for (x = 0; x < MAXCHVEC; x++) next[x] = 31;
+	Count key = keyAttr(r);
+	if (key != NO_KEY) {
+		// skip key bits the string already used
+		Bool used[MAXBITS] = {FALSE};
+		for (x = 0; x < i; x++)
+			if (cv[x].att == key) used[cv[x].bit] = TRUE;
+		Count b = 31;
+		for (; i < MAXCHVEC; i++, b--) {
+			while (used[b]) b--;
+			cv[i].att = key; cv[i].bit = b;
+			printf("cv[%d] is (%d,%d)\n", i, cv[i].att, cv[i].bit);
+		}
+	}
 	x = 0;
 	while (i < MAXCHVEC) {
 		cv[i].att = x; cv[i].bit = next[x];
@@ -68,3 +90,68 @@ void printChVec(ChVec cv)
 	}
 	printf("\n");
 }
+
+// is bit of att's hashes set in about half of the tuples?
+
+Bool balancedBit(Sketch sk, int att, int bit)
+{
+	return fabs(sketchBalance(sk, att, bit) - 0.5) <= SKEW;
+}
+
+// rewrite the items of a choice vector at positions from onwards,
+//   which aren't yet used to choose buckets, using what the sketches
+//   show about the tuples inserted so far
+// an attribute with n distinct values can usefully give log2(n) bits
+//   (more just address buckets none of its values hash to), and a
+//   skewed bit sends most tuples the same way; only such items are
+//   replaced, by a balanced bit of the attribute with the most bits to
+//   spare, so items that are still useful are left as given
+// returns the number of items changed
+
+Count adaptChVec(ChVec cv, Count from, Count nattrs, Sketch sk)
+{
+	int spare[MAXATTRS];  // bits an attribute can give, less bits taken
+	Bool taken[MAXATTRS][MAXBITS];
+	memset(taken, 0, sizeof(taken));
+	for (int a = 0; a < nattrs; a++) {
+		double ndv = sketchDistinct(sk, a);
+		spare[a] = (ndv < 2) ? 0 : (int)floor(log2(ndv));
+	}
+	for (Count j = 0; j < from; j++) {
+		spare[cv[j].att]--;
+		taken[cv[j].att][cv[j].bit] = TRUE;
+	}
+	Count changed = 0;
+	for (Count j = from; j < MAXCHVEC; j++) {
+		int a = cv[j].att, b = cv[j].bit;
+		// a useful item is kept as it is
+		Bool useless = taken[a][b] || !balancedBit(sk, a, b);
+		if (!useless && spare[a] > 0) {
+			spare[a]--;
+			taken[a][b] = TRUE;
+			continue;
+		}
+		// how good the current item is (INT_MIN if useless)
+		int best = useless ? INT_MIN : spare[a];
+		// the highest untaken balanced bit of a better attribute
+		for (int a2 = 0; a2 < nattrs; a2++) {
+			if (spare[a2] <= best) continue;
+			for (int b2 = MAXBITS-1; b2 >= 0; b2--) {
+				if (taken[a2][b2] || !balancedBit(sk, a2, b2)) continue;
+				a = a2; b = b2; best = spare[a2];
+				break;
+			}
+		}
+		if (taken[a][b]) {
+			// nothing balanced left; any untaken bit will have to do
+			for (b = MAXBITS-1; taken[a][b]; b--) ;
+		}
+		if (a != cv[j].att || b != cv[j].bit) {
+			cv[j].att = a; cv[j].bit = b;
+			changed++;
+		}
+		spare[a]--;
+		taken[a][b] = TRUE;
+	}
+	return changed;
+}
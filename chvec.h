@@ -9,6 +9,7 @@
 
 #include "defs.h"
 #include "reln.h"
+#include "sketch.h"
 
 #define MAXCHVEC 32
 
@@ -18,5 +19,7 @@ typedef ChVecItem ChVec[MAXCHVEC];
 
 Status parseChVec(Reln r, char *str, ChVec cv);
 void printChVec(ChVec cv);
+Bool balancedBit(Sketch sk, int att, int bit);
+Count adaptChVec(ChVec cv, Count from, Count nattrs, Sketch sk);
 
 #endif
@@ -0,0 +1,115 @@
+// compress.c ... page compression functions
+// part of Multi-attribute Linear-hashed Files
+// A byte-oriented LZ77 compressor using the LZ4 block format:
+//   a compressed block is a sequence of sequences, each of which is
+//   token (hi 4 bits: #literals, lo 4 bits: match length - MINMATCH)
+//   [more #literals bytes, if hi nibble is 15]
+//   literal bytes
+//   match offset (2 bytes, little-endian)
+//   [more match length bytes, if lo nibble is 15]
+// The last sequence consists of literals only
+// It's fast, and pages (small records, zeroed free space) compress well
+
+#include "defs.h"
+#include "compress.h"
+
+#define MINMATCH  4
+#define HASHBITS  10
+#define MAXOFFSET 65535
+
+static unsigned int read32(char *p)
+{
+	unsigned int v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static int hash4(char *p)
+{
+	return (read32(p) * 2654435761u) >> (32-HASHBITS);
+}
+
+// write a length in token-extension form (255,255,...,rest)
+
+static char *putLength(char *op, int len)
+{
+	while (len >= 255) { *op++ = (char)255; len -= 255; }
+	*op++ = (char)len;
+	return op;
+}
+
+// compress n bytes from src into dst (of size max)
+// returns compressed length, or -1 if it doesn't fit in max
+
+int lzCompress(char *src, int n, char *dst, int max)
+{
+	int table[1<<HASHBITS];
+	for (int i = 0; i < (1<<HASHBITS); i++) table[i] = -1;
+	char *op = dst, *end = dst + max;
+	int ip = 0, anchor = 0;
+	while (ip + MINMATCH <= n) {
+		int h = hash4(src+ip);
+		int ref = table[h];
+		table[h] = ip;
+		if (ref < 0 || ip-ref > MAXOFFSET || read32(src+ref) != read32(src+ip)) {
+			ip++;
+			continue;
+		}
+		int mlen = MINMATCH;
+		while (ip+mlen < n && src[ref+mlen] == src[ip+mlen]) mlen++;
+		// worst case space for this sequence
+		int nlit = ip - anchor;
+		if (op + 1 + nlit/255+1 + nlit + 2 + mlen/255+1 > end) return -1;
+		char *token = op++;
+		*token = (char)(((nlit < 15 ? nlit : 15) << 4) |
+		                (mlen-MINMATCH < 15 ? mlen-MINMATCH : 15));
+		if (nlit >= 15) op = putLength(op, nlit-15);
+		memcpy(op, src+anchor, nlit); op += nlit;
+		int off = ip - ref;
+		*op++ = (char)(off & 0xff);
+		*op++ = (char)(off >> 8);
+		if (mlen-MINMATCH >= 15) op = putLength(op, mlen-MINMATCH-15);
+		ip += mlen;
+		anchor = ip;
+	}
+	// final literals
+	int nlit = n - anchor;
+	if (op + 1 + nlit/255+1 + nlit > end) return -1;
+	*op++ = (char)((nlit < 15 ? nlit : 15) << 4);
+	if (nlit >= 15) op = putLength(op, nlit-15);
+	memcpy(op, src+anchor, nlit); op += nlit;
+	return op - dst;
+}
+
+// decompress n bytes from src into dst (of size max)
+// returns decompressed length, or -1 if src is malformed
+
+int lzDecompress(char *src, int n, char *dst, int max)
+{
+	unsigned char *ip = (unsigned char *)src, *iend = ip + n;
+	char *op = dst, *oend = dst + max;
+	while (ip < iend) {
+		int token = *ip++;
+		int nlit = token >> 4;
+		if (nlit == 15) {
+			int b;
+			do { if (ip >= iend) return -1; b = *ip++; nlit += b; } while (b == 255);
+		}
+		if (ip + nlit > iend || op + nlit > oend) return -1;
+		memcpy(op, ip, nlit); op += nlit; ip += nlit;
+		if (ip == iend) break;
+		if (ip + 2 > iend) return -1;
+		int off = ip[0] | (ip[1] << 8);
+		ip += 2;
+		int mlen = (token & 15) + MINMATCH;
+		if ((token & 15) == 15) {
+			int b;
+			do { if (ip >= iend) return -1; b = *ip++; mlen += b; } while (b == 255);
+		}
+		if (off == 0 || off > op - dst || op + mlen > oend) return -1;
+		// byte-by-byte, since a match may overlap its own output
+		char *ref = op - off;
+		for (int i = 0; i < mlen; i++) *op++ = *ref++;
+	}
+	return op - dst;
+}
@@ -0,0 +1,11 @@
+// compress.h ... interface to page compression functions
+// part of Multi-attribute Linear-hashed Files
+// See compress.c for details of the compressed format
+
+#ifndef COMPRESS_H
+#define COMPRESS_H 1
+
+int lzCompress(char *src, int n, char *dst, int max);
+int lzDecompress(char *src, int n, char *dst, int max);
+
+#endif
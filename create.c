@@ -1,18 +1,72 @@
 // create.c ... create an empty Relation
 // part of Multi-attribute linear-hashed files
 // Ask a query on a named file
-// Usage:  ./create  [-v]  RelName  #attrs  #pages  ChoiceVector
+// Usage:  ./create  [-v]  [-z]  [-P]  [-L]  [-S]  [-A]  [-s schema]  [-D attrs]  [-k att]  RelName  #attrs  #pages  ChoiceVector
 // where #attrs = # of attributes in each tuple
 //	   #pages = initial (empty) pages in File
 //	   ChoiceVector = attr,bit:attr,bit:...
+//	   -L = store long text values out of line, in a value heap
+//	   -S = defer bucket splits: inserts only count the splits due,
+//	        and the split command carries them out
+//	   -A = adaptive choice vector: as the file grows, the positions
+//	        not yet used to choose buckets are rewritten to use the
+//	        hash bits that best spread the tuples inserted so far
+//	   -s schema = comma-separated list of attribute types, one of
+//	              int32, int64 or text for each attribute
+//	              (e.g. -s int32,text,text); default is all text
+//	   -D attrs = comma-separated list of attributes to store
+//	              dictionary-encoded (e.g. -D 1,2)
+//	   -k att = attribute att is a unique key: insert rejects a tuple
+//	            whose key value is already in the relation, and a query
+//	            stops once it has found the tuple for each key value;
+//	            bits not in ChoiceVector all come from the key
+//	   -z = store pages compressed (for archival relations)
+//	   -P = PAX page layout: each page stores the values of each
+//	        attribute together, in its own minipage
 
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 #include "util.h"
 #include "reln.h"
 
-#define USAGE "./create  [-v]  RelName  #attrs  #pages  ChoiceVector"
+#define USAGE "./create  [-v]  [-z]  [-P]  [-L]  [-S]  [-A]  [-s schema]  [-D attrs]  [-k att]  RelName  #attrs  #pages  ChoiceVector"
+
+// set enc[a] = how for each attribute a in list "a,b,..."
+// returns OK, or ~OK if the list contains an invalid attribute
+
+static Status parseAttrList(char *list, int nattrs, Byte *enc, Byte how)
+{
+	char *c = list;
+	while (*c != '\0') {
+		char *end;
+		long a = strtol(c, &end, 10);
+		if (end == c || a < 0 || a >= nattrs) return ~OK;
+		if (*end != ',' && *end != '\0') return ~OK;
+		enc[a] = how;
+		c = (*end == ',') ? end+1 : end;
+	}
+	return OK;
+}
+
+// set enc[] from a schema "type,type,..." with a type for each attribute
+// returns OK, or ~OK if the schema is invalid
+
+static Status parseSchema(char *schema, int nattrs, Byte *enc)
+{
+	char *c = schema;
+	for (int a = 0; a < nattrs; a++) {
+		int len = strcspn(c, ",");
+		if (len == 5 && strncmp(c, "int32", 5) == 0) enc[a] = ATT_INT32;
+		else if (len == 5 && strncmp(c, "int64", 5) == 0) enc[a] = ATT_INT64;
+		else if (len == 4 && strncmp(c, "text", 4) == 0) enc[a] = ATT_TEXT;
+		else return ~OK;
+		c += len;
+		if (a < nattrs-1 && *c++ != ',') return ~OK;
+	}
+	return (*c == '\0') ? OK : ~OK;
+}
 
 
 // Main ... process args, create relation
@@ -23,23 +77,37 @@ int main(int argc, char **argv)
 	int nattrs;  // number of attributes in each tuple
 	int npages;  // initial number of pages
 	char err[MAXERRMSG];  // buffer for error messages
-	int verbose;  // show extra info on query progress
+	int verbose = 0;  // show extra info on query progress
 	char *rname;  // name of table/file
 	char *attrs;   // number of attributes in tuples
 	char *pages;   // number of pages in data file
 	char *cv;	  // choice vector
+	char *schema = NULL;  // attribute types
+	char *dicts = NULL;  // attributes to dictionary-encode
+	char *key = NULL;  // unique key attribute
+	Byte enc[MAXATTRS];  // storage for each attribute
+	Count flags = 0;  // relation options
+	int opt;
 
 	// Process command-line args
 
-	if (argc < 2) fatal(USAGE);
-	if (strcmp(argv[1], "-v") == 0) {
-		if (argc < 6) fatal(USAGE);
-	    verbose = 1; rname = argv[2]; attrs = argv[3]; pages = argv[4]; cv = argv[5];
-	}
-	else {
-		if (argc < 5) fatal(USAGE);
-	    verbose = 0; rname = argv[1]; attrs = argv[2]; pages = argv[3]; cv = argv[4];
+	while ((opt = getopt(argc, argv, "+vzPLSAs:D:k:")) != -1) {
+		switch (opt) {
+		case 'v': verbose = 1; break;
+		case 's': schema = optarg; break;
+		case 'D': dicts = optarg; break;
+		case 'k': key = optarg; break;
+		case 'z': flags |= RELN_COMPRESSED; break;
+		case 'P': flags |= RELN_PAX; break;
+		case 'L': flags |= RELN_OUTOFLINE; break;
+		case 'S': flags |= RELN_DEFERSPLIT; break;
+		case 'A': flags |= RELN_ADAPTIVE; break;
+		default:  fatal(USAGE);
+		}
 	}
+	if (argc - optind < 4) fatal(USAGE);
+	rname = argv[optind]; attrs = argv[optind+1];
+	pages = argv[optind+2]; cv = argv[optind+3];
 
 	// how many attributes in each tuple
 	nattrs = atoi(attrs);
@@ -48,6 +116,37 @@ int main(int argc, char **argv)
 		fatal(err);
 	}
 
+	// how each attribute is stored
+	memset(enc, ATT_TEXT, MAXATTRS);
+	if (schema != NULL && parseSchema(schema, nattrs, enc) != OK) {
+		sprintf(err, "Invalid schema: %.64s", schema);
+		fatal(err);
+	}
+	Byte types[MAXATTRS];
+	memcpy(types, enc, MAXATTRS);
+	if (dicts != NULL && parseAttrList(dicts, nattrs, enc, ATT_DICT) != OK) {
+		sprintf(err, "Invalid attribute list: %.64s", dicts);
+		fatal(err);
+	}
+	for (int a = 0; a < nattrs; a++) {
+		if (enc[a] == ATT_DICT && types[a] != ATT_TEXT) {
+			sprintf(err, "Attribute %d is an integer; only text can be dictionary-encoded", a);
+			fatal(err);
+		}
+	}
+
+	// which attribute, if any, is a key
+	Count keyatt = NO_KEY;
+	if (key != NULL) {
+		char *end;
+		long a = strtol(key, &end, 10);
+		if (end == key || *end != '\0' || a < 0 || a >= nattrs) {
+			sprintf(err, "Invalid key attribute: %.64s", key);
+			fatal(err);
+		}
+		keyatt = a;
+	}
+
 	// how many initally empty pages
 	npages = atoi(pages);
 	if (npages < 1 || npages > 64) {
@@ -68,7 +167,7 @@ int main(int argc, char **argv)
 		sprintf(err, "Relation %s already exists", rname);
 		fatal(err);
 	}
-	if (newRelation(rname, nattrs, np, d, cv) != OK) {
+	if (newRelation(rname, nattrs, np, d, cv, enc, flags, keyatt) != OK) {
 		sprintf(err, "Problems while creating relation %s", rname);
 		fatal(err);
 	}
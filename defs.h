@@ -13,10 +13,17 @@
 
 #define PAGESIZE    1024
 #define NO_PAGE     0xffffffff
+#define RESERVED    0xfffffffe
+#define OVEXTENT    4
+#define PREFETCH    4
 #define MAXERRMSG   200
 #define MAXTUPLEN   200
+#define MAXRECLEN   (MAXTUPLEN+8*MAXATTRS)
+#define MAXLINE     8192
+#define INLINEMAX   24
+#define MAXATTRS    10
 #define MAXRELNAME  200
-#define MAXFILENAME MAXRELNAME+8
+#define MAXFILENAME MAXRELNAME+16
 #define MAXBITS     32
 #define OK          0
 #define TRUE        1
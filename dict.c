@@ -0,0 +1,175 @@
+// dict.c ... dictionaries of attribute values
+// part of Multi-attribute Linear-hashed Files
+// A dictionary-encoded attribute stores a small integer id in each
+//   tuple instead of the value itself, which pays off when the
+//   attribute has few distinct values, each repeated many times
+// The relation's dictionary file (R.dict) is a sequence of entries,
+//   appended as values are first seen:
+//   attribute# (1 byte), value length (2 bytes), value bytes
+// Ids are assigned per attribute, in the order values first appear
+
+#include "defs.h"
+#include "dict.h"
+#include "hash.h"
+
+// the values of one attribute
+struct AttDict {
+	Count  nvals;   // number of values (= next id to assign)
+	Count  maxvals; // allocated size of vals[] and hashes[]
+	char **vals;    // id -> value
+	Bits  *hashes;  // id -> hash_any(value), reused for tuple hashes
+	Count  nslots;  // size of slots[] (a power of 2)
+	Count *slots;   // open-addressing hash table of ids
+};
+
+struct DictRep {
+	FILE  *f;       // handle on dictionary file
+	Count  nattrs;  // number of attributes in relation
+	struct AttDict att[MAXATTRS];
+};
+
+// find the slot for val in an attribute's hash table
+// either the slot holding its id, or the empty slot where it belongs
+
+static Count *findSlot(struct AttDict *a, char *val, Bits h)
+{
+	Count mask = a->nslots-1;
+	Count i = h & mask;
+	while (a->slots[i] != NO_ID) {
+		Count id = a->slots[i];
+		if (a->hashes[id] == h && strcmp(a->vals[id],val) == 0) break;
+		i = (i+1) & mask;
+	}
+	return &a->slots[i];
+}
+
+// rebuild an attribute's hash table with nslots entries
+
+static void resizeSlots(struct AttDict *a, Count nslots)
+{
+	free(a->slots);
+	a->nslots = nslots;
+	a->slots = malloc(nslots*sizeof(Count));
+	assert(a->slots != NULL);
+	for (Count i = 0; i < nslots; i++) a->slots[i] = NO_ID;
+	for (Count id = 0; id < a->nvals; id++)
+		*findSlot(a, a->vals[id], a->hashes[id]) = id;
+}
+
+// add a new value to an attribute's in-memory dictionary
+
+static Count addValue(struct AttDict *a, char *val, Bits h)
+{
+	if (a->nvals == a->maxvals) {
+		a->maxvals = (a->maxvals == 0) ? 64 : 2*a->maxvals;
+		a->vals = realloc(a->vals, a->maxvals*sizeof(char *));
+		a->hashes = realloc(a->hashes, a->maxvals*sizeof(Bits));
+		assert(a->vals != NULL && a->hashes != NULL);
+	}
+	Count id = a->nvals++;
+	a->vals[id] = copyString(val);
+	a->hashes[id] = h;
+	// keep hash table at most half full
+	if (2*a->nvals > a->nslots)
+		resizeSlots(a, 2*a->nslots);
+	else
+		*findSlot(a, val, h) = id;
+	return id;
+}
+
+// open a dictionary file and load its contents
+// mode is "w" to create an empty dictionary, or as for openRelation
+
+Dict openDict(char *name, char *mode, Count nattrs)
+{
+	char fname[MAXFILENAME];
+	sprintf(fname,"%s.dict",name);
+	Dict d = malloc(sizeof(struct DictRep));
+	assert(d != NULL);
+	if (mode[0] == 'w')
+		d->f = fopen(fname,"w");
+	else
+		d->f = fopen(fname, strchr(mode,'+') != NULL ? "r+" : "r");
+	if (d->f == NULL) { free(d); return NULL; }
+	d->nattrs = nattrs;
+	for (int i = 0; i < MAXATTRS; i++) {
+		struct AttDict *a = &d->att[i];
+		a->nvals = a->maxvals = 0;
+		a->vals = NULL; a->hashes = NULL;
+		a->nslots = 0; a->slots = NULL;
+		resizeSlots(a, 64);
+	}
+	Byte att; unsigned short len;
+	char val[MAXLINE];
+	while (fread(&att, 1, 1, d->f) == 1) {
+		int n = fread(&len, sizeof(len), 1, d->f);
+		assert(n == 1 && att < nattrs && len < MAXLINE);
+		n = fread(val, 1, len, d->f);
+		assert(n == len);
+		val[len] = '\0';
+		addValue(&d->att[att], val, hash_any((unsigned char *)val,len));
+	}
+	// any new entries are appended
+	fseek(d->f, 0, SEEK_END);
+	return d;
+}
+
+// write out any new entries and release dictionary
+
+void closeDict(Dict d)
+{
+	fclose(d->f);
+	for (int i = 0; i < MAXATTRS; i++) {
+		struct AttDict *a = &d->att[i];
+		for (Count id = 0; id < a->nvals; id++) free(a->vals[id]);
+		free(a->vals); free(a->hashes); free(a->slots);
+	}
+	free(d);
+}
+
+// id of a value, or NO_ID if not in the dictionary
+
+Count dictLookup(Dict d, int att, char *val)
+{
+	struct AttDict *a = &d->att[att];
+	Bits h = hash_any((unsigned char *)val,strlen(val));
+	return *findSlot(a, val, h);
+}
+
+// id of a value, adding it to the dictionary if it's new
+
+Count dictIntern(Dict d, int att, char *val)
+{
+	struct AttDict *a = &d->att[att];
+	int len = strlen(val);
+	Bits h = hash_any((unsigned char *)val,len);
+	Count id = *findSlot(a, val, h);
+	if (id != NO_ID) return id;
+	id = addValue(a, val, h);
+	Byte b = att; unsigned short l = len;
+	fwrite(&b, 1, 1, d->f);
+	fwrite(&l, sizeof(l), 1, d->f);
+	fwrite(val, 1, len, d->f);
+	return id;
+}
+
+// value for an id, and its hash
+
+char *dictValue(Dict d, int att, Count id)
+{
+	assert(id < d->att[att].nvals);
+	return d->att[att].vals[id];
+}
+
+Bits dictHash(Dict d, int att, Count id)
+{
+	assert(id < d->att[att].nvals);
+	return d->att[att].hashes[id];
+}
+
+// number of distinct values seen for an attribute
+
+Count dictSize(Dict d, int att)
+{
+	return d->att[att].nvals;
+}
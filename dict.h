@@ -0,0 +1,23 @@
+// dict.h ... interface to attribute value dictionaries
+// part of Multi-attribute Linear-hashed Files
+// See dict.c for details of Dict type and functions
+
+#ifndef DICT_H
+#define DICT_H 1
+
+typedef struct DictRep *Dict;
+
+#include "defs.h"
+#include "bits.h"
+
+#define NO_ID 0xffffffff
+
+Dict openDict(char *name, char *mode, Count nattrs);
+void closeDict(Dict d);
+Count dictLookup(Dict d, int att, char *val);
+Count dictIntern(Dict d, int att, char *val);
+char *dictValue(Dict d, int att, Count id);
+Bits dictHash(Dict d, int att, Count id);
+Count dictSize(Dict d, int att);
+
+#endif
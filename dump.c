@@ -6,8 +6,9 @@
 #include "defs.h"
 #include "reln.h"
 #include "page.h"
+#include "tuple.h"
 
-void showAllTuples(Page);
+void showAllTuples(Reln, Page);
 
 #define USAGE "./dump  RelName"
 
@@ -32,14 +33,14 @@ int main(int argc, char **argv)
 		printf("Bucket[%d]\n",pid);
 		// show tuples in data file
 		Page pg = getPage(dataFile(r),pid);
-		showAllTuples(pg);
+		showAllTuples(r, pg);
 		// show tuples in overflow pages
 		Page ovpg;  PageID ovp;
 		ovp = pageOvflow(pg);
 		while (ovp != NO_PAGE) {
 			printf("Ovflow->\n");
 			ovpg = getPage(ovflowFile(r), ovp);
-			showAllTuples(ovpg);
+			showAllTuples(r, ovpg);
 			ovp = pageOvflow(ovpg);
 			free(ovpg);
 		}
@@ -52,12 +53,14 @@ int main(int argc, char **argv)
 
 // scan all tuples in Page
 
-void showAllTuples(Page pg)
+void showAllTuples(Reln r, Page pg)
 {
-		Count ntups = pageNTuples(pg);
-		char *c = pageData(pg);
-		for (int i = 0; i < ntups; i++) {
-			printf("%s\n", c);
-			c += strlen(c) + 1;
+		RecScan s;
+		char *rec, tup[MAXLINE];
+		Count len;
+		startRecScan(r, pg, &s);
+		while ((rec = nextRecord(r, &s, &len)) != NULL) {
+			recordToTuple(r, rec, tup);
+			printf("%s\n", tup);
 		}
 }
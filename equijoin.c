@@ -0,0 +1,428 @@
+// equijoin.c ... equi-joins of two Relations
+// part of Multi-attribute Linear-hashed Files
+// Joins R and S on R.a = S.b, writing each result tuple (R's values
+//   followed by S's) to a stream as soon as it's found
+// If both choice vectors start with the same P bits of the join
+//   attributes' hashes, tuples with equal join values are in buckets
+//   whose lowest P bits agree; the join is then done partition-wise,
+//   one group of buckets (those with the same lowest P bits) at a
+//   time, and each bucket is read once
+// Otherwise, it's a grace hash join: both relations are partitioned
+//   on the join attribute's hash into temporary files, and then each
+//   pair of partitions is joined; a partition too big for memory is
+//   partitioned again, on further bits of the hash
+// Either way, only one group or partition of the smaller relation is
+//   held in memory at a time, in a hash table on the join value
+
+#include "defs.h"
+#include "equijoin.h"
+#include "reln.h"
+#include "tuple.h"
+#include "page.h"
+#include "hash.h"
+#include "arena.h"
+
+#define JOINMEM  (1<<22)  // bytes of build tuples to aim for in memory
+#define PARTBITS 6        // hash bits that choose a grace partition
+#define MAXPARTS (1<<PARTBITS)       // most partitions at each level
+#define MAXLEVEL (MAXBITS/PARTBITS)  // most levels of partitioning
+
+// one side of a join
+typedef struct {
+	Reln r;
+	int  att;
+	Bool stored;  // use the relation's own attribute hashes?
+} Side;
+
+// a build tuple in the hash table
+typedef struct Entry {
+	Bits   hash;
+	char  *key;    // join attribute value
+	char  *tuple;
+	struct Entry *next;
+} Entry;
+
+typedef struct {
+	Count   nslots;   // a power of 2
+	Count   n;
+	Entry **slots;
+	Arena   arena;    // entries and their tuples
+} Table;
+
+// copy the value of attribute i of a tuple into buf
+
+static char *attrValue(char *tuple, int i, char *buf)
+{
+	char *c = tuple;
+	for (int k = 0; k < i; k++) c = strchr(c, ',') + 1;
+	int len = strcspn(c, ",");
+	memcpy(buf, c, len);
+	buf[len] = '\0';
+	return buf;
+}
+
+// hash of a tuple's join value, given its record and (if the side
+//   doesn't use stored hashes) its printable form
+
+static Bits joinHash(Side *sd, char *rec, char *tuple)
+{
+	if (sd->stored) return recordAttrHash(sd->r, rec, sd->att);
+	char val[MAXLINE];
+	attrValue(tuple, sd->att, val);
+	return hash_any((unsigned char *)val, strlen(val));
+}
+
+static void tableInit(Table *t, Count nslots)
+{
+	t->nslots = nslots;
+	t->n = 0;
+	t->slots = calloc(nslots, sizeof(Entry *));
+	assert(t->slots != NULL);
+	t->arena = newArena();
+}
+
+// double the number of slots, keeping chains short
+
+static void tableGrow(Table *t)
+{
+	Count nslots = 2*t->nslots;
+	Entry **slots = calloc(nslots, sizeof(Entry *));
+	assert(slots != NULL);
+	for (Count i = 0; i < t->nslots; i++) {
+		Entry *e = t->slots[i];
+		while (e != NULL) {
+			Entry *next = e->next;
+			Count j = e->hash & (nslots-1);
+			e->next = slots[j];
+			slots[j] = e;
+			e = next;
+		}
+	}
+	free(t->slots);
+	t->slots = slots;
+	t->nslots = nslots;
+}
+
+static void tableAdd(Table *t, Bits hash, char *tuple, int att)
+{
+	Entry *e = arenaAlloc(t->arena, sizeof(Entry));
+	char val[MAXLINE];
+	e->hash = hash;
+	e->tuple = arenaString(t->arena, tuple);
+	e->key = arenaString(t->arena, attrValue(tuple, att, val));
+	if (++t->n > 2*t->nslots) tableGrow(t);
+	Count i = hash & (t->nslots-1);
+	e->next = t->slots[i];
+	t->slots[i] = e;
+}
+
+static void tableFree(Table *t)
+{
+	free(t->slots);
+	freeArena(t->arena);
+}
+
+// write a result tuple: R's values first
+
+static void emit(FILE *out, char *rtup, char *stup)
+{
+	fputs(rtup, out);
+	putc(',', out);
+	fputs(stup, out);
+	putc('\n', out);
+}
+
+// find the build tuples matching a probe tuple, and write the results
+// the probe tuple's printable form is only made if some hash matches
+// returns the number of results
+
+static Count probe(Table *t, Side *pr, char *rec, char *tuple, Bits hash,
+                   Bool buildIsR, FILE *out)
+{
+	Count n = 0;
+	char tbuf[MAXLINE], val[MAXLINE];
+	char *key = NULL;
+	for (Entry *e = t->slots[hash & (t->nslots-1)]; e != NULL; e = e->next) {
+		if (e->hash != hash) continue;
+		if (key == NULL) {
+			if (tuple == NULL) {
+				recordToTuple(pr->r, rec, tbuf);
+				tuple = tbuf;
+			}
+			key = attrValue(tuple, pr->att, val);
+		}
+		if (strcmp(e->key, key) != 0) continue;
+		if (buildIsR) emit(out, e->tuple, tuple);
+		else emit(out, tuple, e->tuple);
+		n++;
+	}
+	return n;
+}
+
+// a scan through the records of one bucket, along its chain
+
+typedef struct {
+	Reln    r;
+	Page    pg;
+	RecScan s;
+} BucketScan;
+
+static void startBucket(BucketScan *b, Reln r, PageID pid)
+{
+	b->r = r;
+	b->pg = getPage(dataFile(r), pid);
+	prefetchPages(ovflowFile(r), pageOvflow(b->pg), PREFETCH);
+	startRecScan(r, b->pg, &b->s);
+}
+
+static char *nextInBucket(BucketScan *b)
+{
+	Count len;
+	while (b->pg != NULL) {
+		char *rec = nextRecord(b->r, &b->s, &len);
+		if (rec != NULL) return rec;
+		PageID ov = pageOvflow(b->pg);
+		free(b->pg);
+		b->pg = NULL;
+		if (ov == NO_PAGE) break;
+		b->pg = getPage(ovflowFile(b->r), ov);
+		startRecScan(b->r, b->pg, &b->s);
+	}
+	return NULL;
+}
+
+// bytes in a relation's data and overflow files
+
+static long long relnBytes(Reln r)
+{
+	return (long long)(filePages(dataFile(r)) + filePages(ovflowFile(r)))
+	       * PAGESIZE;
+}
+
+// do the two relations hash their join attributes alike?
+// (integers are hashed differently from text)
+
+static Bool sameHashes(Reln r, int a, Reln s, int b)
+{
+	return (fieldWidth(attrEncoding(r,a)) > 0) ==
+	       (fieldWidth(attrEncoding(s,b)) > 0);
+}
+
+// number of low-order bucket address bits that are the same for
+//   tuples with the same join value in R and S, and so can be used
+//   for a partition-wise join; 0 if there are none, or if a group of
+//   buckets of the smaller relation wouldn't fit in memory
+
+int joinPartitionBits(Reln r, int a, Reln s, int b)
+{
+	if (!sameHashes(r, a, s, b)) return 0;
+	ChVecItem *cr = chvec(r), *cs = chvec(s);
+	int p = 0;
+	while (p < MAXCHVEC && cr[p].att == a && cs[p].att == b &&
+	       cr[p].bit == cs[p].bit)
+		p++;
+	if (p > depth(r)) p = depth(r);
+	if (p > depth(s)) p = depth(s);
+	long long bytes = relnBytes(r) < relnBytes(s) ? relnBytes(r) : relnBytes(s);
+	if ((bytes >> p) > JOINMEM) return 0;
+	return p;
+}
+
+// partition-wise join, on the lowest p bits of bucket addresses
+
+static Count partitionJoin(Side *bd, Side *pr, int p, Bool buildIsR,
+                           FILE *out)
+{
+	Count n = 0, groups = (Count)1 << p;
+	char tuple[MAXLINE];
+	for (Count g = 0; g < groups; g++) {
+		Table t;
+		tableInit(&t, 1024);
+		BucketScan bs;
+		char *rec;
+		for (PageID pid = g; pid < npages(bd->r); pid += groups) {
+			startBucket(&bs, bd->r, pid);
+			while ((rec = nextInBucket(&bs)) != NULL) {
+				recordToTuple(bd->r, rec, tuple);
+				tableAdd(&t, joinHash(bd, rec, tuple), tuple, bd->att);
+			}
+		}
+		for (PageID pid = g; pid < npages(pr->r); pid += groups) {
+			startBucket(&bs, pr->r, pid);
+			while ((rec = nextInBucket(&bs)) != NULL) {
+				char *tup = NULL;
+				if (!pr->stored) {
+					recordToTuple(pr->r, rec, tuple);
+					tup = tuple;
+				}
+				n += probe(&t, pr, rec, tup, joinHash(pr, rec, tup),
+				           buildIsR, out);
+			}
+		}
+		tableFree(&t);
+	}
+	return n;
+}
+
+// which of nparts partitions a join hash goes to, at a level of
+//   partitioning: each level takes the next PARTBITS bits down from
+//   the top of the hash, so a partition that's partitioned again is
+//   split on bits its tuples don't all share
+
+static Count partOf(Bits h, int level, Count nparts)
+{
+	return ((h >> (MAXBITS - PARTBITS*(level+1))) & (MAXPARTS-1)) % nparts;
+}
+
+// number of partitions for bytes of build tuples
+
+static Count partCount(long long bytes)
+{
+	long long nparts = bytes / JOINMEM + 1;
+	return (nparts > MAXPARTS) ? MAXPARTS : nparts;
+}
+
+static void openParts(FILE **parts, Count nparts)
+{
+	for (Count i = 0; i < nparts; i++) {
+		parts[i] = tmpfile();
+		if (parts[i] == NULL)
+			fatal("Can't create join partition files");
+	}
+}
+
+// append a tuple to a partition file, as: hash, length, printable tuple
+
+static void writePart(FILE *f, Bits h, char *tuple)
+{
+	Count len = strlen(tuple);
+	fwrite(&h, sizeof(h), 1, f);
+	fwrite(&len, sizeof(len), 1, f);
+	fwrite(tuple, 1, len, f);
+}
+
+// read the next tuple from a partition file; FALSE at end
+
+static Bool readPart(FILE *f, Bits *h, char *tuple)
+{
+	Count len;
+	if (fread(h, sizeof(*h), 1, f) != 1) return FALSE;
+	if (fread(&len, sizeof(len), 1, f) != 1) return FALSE;
+	assert(len < MAXLINE);
+	if (fread(tuple, 1, len, f) != len) return FALSE;
+	tuple[len] = '\0';
+	return TRUE;
+}
+
+// write every tuple of a relation to one of nparts partition files,
+//   chosen by its join hash
+
+static void partition(Side *sd, FILE **parts, Count nparts)
+{
+	char tuple[MAXLINE];
+	BucketScan bs;
+	char *rec;
+	for (PageID pid = 0; pid < npages(sd->r); pid++) {
+		startBucket(&bs, sd->r, pid);
+		while ((rec = nextInBucket(&bs)) != NULL) {
+			recordToTuple(sd->r, rec, tuple);
+			Bits h = joinHash(sd, rec, tuple);
+			writePart(parts[partOf(h, 0, nparts)], h, tuple);
+		}
+	}
+}
+
+// split a partition file into nparts, at the given level
+
+static void repartition(FILE *f, FILE **parts, Count nparts, int level)
+{
+	char tuple[MAXLINE];
+	Bits h;
+	rewind(f);
+	while (readPart(f, &h, tuple))
+		writePart(parts[partOf(h, level, nparts)], h, tuple);
+	fclose(f);
+}
+
+// join a pair of partitions at some level of partitioning, and close
+//   their files
+// a build partition of more than JOINMEM bytes is partitioned again,
+//   on the next level's hash bits; if it's still too big when the hash
+//   bits run out (many tuples share a join value), it's joined a
+//   JOINMEM-sized chunk at a time, each chunk probed by the whole of
+//   the probe partition
+
+static Count joinParts(Side *bd, Side *pr, FILE *bf, FILE *pf, int level,
+                       Bool buildIsR, FILE *out)
+{
+	fseek(bf, 0, SEEK_END);
+	long long bytes = ftell(bf);
+	if (bytes > JOINMEM && level+1 < MAXLEVEL) {
+		Count nparts = partCount(bytes), n = 0;
+		FILE *bparts[nparts], *pparts[nparts];
+		openParts(bparts, nparts);
+		openParts(pparts, nparts);
+		repartition(bf, bparts, nparts, level+1);
+		repartition(pf, pparts, nparts, level+1);
+		for (Count i = 0; i < nparts; i++)
+			n += joinParts(bd, pr, bparts[i], pparts[i], level+1,
+			               buildIsR, out);
+		return n;
+	}
+	Count n = 0;
+	char tuple[MAXLINE];
+	Bits h;
+	Bool more = TRUE;
+	rewind(bf);
+	while (more) {
+		Table t;
+		tableInit(&t, 1024);
+		long long size = 0;
+		while (size < JOINMEM && (more = readPart(bf, &h, tuple))) {
+			tableAdd(&t, h, tuple, bd->att);
+			size += strlen(tuple);
+		}
+		if (t.n > 0) {
+			rewind(pf);
+			while (readPart(pf, &h, tuple))
+				n += probe(&t, pr, NULL, tuple, h, buildIsR, out);
+		}
+		tableFree(&t);
+	}
+	fclose(bf);
+	fclose(pf);
+	return n;
+}
+
+// grace hash join
+
+static Count graceJoin(Side *bd, Side *pr, Bool buildIsR, FILE *out)
+{
+	Count nparts = partCount(relnBytes(bd->r)), n = 0;
+	FILE *bparts[nparts], *pparts[nparts];
+	openParts(bparts, nparts);
+	openParts(pparts, nparts);
+	partition(bd, bparts, nparts);
+	partition(pr, pparts, nparts);
+	for (Count i = 0; i < nparts; i++)
+		n += joinParts(bd, pr, bparts[i], pparts[i], 0, buildIsR, out);
+	return n;
+}
+
+// join R and S on R.a = S.b, writing result tuples to out
+// how is JOIN_ANY or JOIN_GRACE
+// returns the number of result tuples
+
+Count joinRelations(Reln r, int a, Reln s, int b, int how, FILE *out)
+{
+	Side rs = { r, a, TRUE }, ss = { s, b, TRUE };
+	if (!sameHashes(r, a, s, b)) rs.stored = ss.stored = FALSE;
+	// build on the smaller relation
+	Bool buildIsR = relnBytes(r) <= relnBytes(s);
+	Side *bd = buildIsR ? &rs : &ss;
+	Side *pr = buildIsR ? &ss : &rs;
+	int p = joinPartitionBits(r, a, s, b);
+	if (how == JOIN_ANY && p > 0)
+		return partitionJoin(bd, pr, p, buildIsR, out);
+	return graceJoin(bd, pr, buildIsR, out);
+}
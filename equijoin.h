@@ -0,0 +1,18 @@
+// equijoin.h ... interface to equi-joins of two Relations
+// part of Multi-attribute Linear-hashed Files
+// See equijoin.c for details of the join methods
+
+#ifndef EQUIJOIN_H
+#define EQUIJOIN_H 1
+
+#include "defs.h"
+#include "reln.h"
+
+// join methods
+#define JOIN_ANY   0  // partition-wise if possible, else grace
+#define JOIN_GRACE 1  // grace hash join
+
+int joinPartitionBits(Reln r, int a, Reln s, int b);
+Count joinRelations(Reln r, int a, Reln s, int b, int how, FILE *out);
+
+#endif
@@ -0,0 +1,58 @@
+// expand.c ... grow a Relation ahead of a large load
+// part of Multi-attribute linear-hashed files
+// Splits buckets in advance, in one pass, so that a load that's
+//   about to happen doesn't split them one at a time as it goes
+// Usage:  ./expand  [-v]  (-n K | -p #pages)  RelName
+// -n K splits the next K buckets
+// -p #pages splits buckets until the data file has #pages pages
+
+#include "defs.h"
+#include "reln.h"
+#include <unistd.h>
+
+#define USAGE "./expand  [-v]  (-n K | -p #pages)  RelName"
+
+// Main ... process args, expand relation
+
+int main(int argc, char **argv)
+{
+	Reln r;  // handle on the open relation
+	char err[MAXERRMSG];  // buffer for error messages
+	int verbose = 0;  // show new size
+	int k = -1;  // number of buckets to split
+	int target = -1;  // number of pages wanted
+	char *rname;  // name of table/file
+	int opt;
+
+	// process command-line args
+
+	while ((opt = getopt(argc, argv, "+vn:p:")) != -1) {
+		switch (opt) {
+		case 'v': verbose = 1; break;
+		case 'n': k = atoi(optarg); break;
+		case 'p': target = atoi(optarg); break;
+		default:  fatal(USAGE);
+		}
+	}
+	if (optind >= argc || (k < 0) == (target < 0)) fatal(USAGE);
+	rname = argv[optind];
+
+	// open relation for writing, and expand
+
+	if (!existsRelation(rname)) {
+		sprintf(err, "No such relation: %.100s", rname);
+		fatal(err);
+	}
+	if ((r = openRelation(rname, "r+")) == NULL) {
+		sprintf(err, "Can't open relation: %.100s", rname);
+		fatal(err);
+	}
+	if (target >= 0) k = (target > npages(r)) ? target - npages(r) : 0;
+	Count np = expandRelation(r, k);
+	if (verbose)
+		printf("%d buckets split, now %d pages, d=%d, sp=%d\n",
+		       k, np, depth(r), splitp(r));
+	closeRelation(r);
+
+	return 0;
+}
@@ -94,3 +94,17 @@ hash_any(unsigned char *k, int keylen)
 	final(a, b, c);
 	return c;
 }
+
+// hash of an integer value (the 64-bit finaliser from MurmurHash3,
+//   folded to 32 bits); much cheaper than hash_any on its digits
+
+Bits hash_int(long long v)
+{
+	unsigned long long h = v;
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return (Bits)(h ^ (h >> 32));
+}
@@ -8,5 +8,6 @@
 #include "bits.h"
 
 Bits hash_any(unsigned char *, int);
+Bits hash_int(long long);
 
 #endif
@@ -0,0 +1,121 @@
+// heap.c ... out-of-line storage for long attribute values
+// part of Multi-attribute Linear-hashed Files
+// In a RELN_OUTOFLINE relation, a text value longer than INLINEMAX
+//   is appended to the relation's value heap file (R.heap), and the
+//   tuple holds a fixed-size reference to it in place of the value:
+//   HEAPREF, hash (5 bytes), length (3 bytes), offset (5 bytes), '\0'
+// Each byte between HEAPREF and the '\0' holds 7 bits, with the top
+//   bit set, so a reference is a '\0'-terminated text field like any
+//   other, and page scans find field boundaries in the same way
+// The hash and length come first, so that a query can look for a
+//   long value's reference prefix, and fetch the value itself only
+//   for the tuples that have it
+
+#include "defs.h"
+#include "heap.h"
+#include <fcntl.h>
+#include <unistd.h>
+
+// the heap is accessed with positional reads/writes only, so that
+//   threads sharing a relation can fetch values at the same time
+struct HeapRep {
+	int  fd;     // value heap file
+	long long size; // bytes in file
+};
+
+// write v into n bytes of 7 bits, low-order bits first
+
+static char *put7(char *c, unsigned long long v, int n)
+{
+	for (int i = 0; i < n; i++, v >>= 7)
+		*c++ = (char)(0x80 | (v & 0x7f));
+	return c;
+}
+
+static unsigned long long get7(char *c, int n)
+{
+	unsigned long long v = 0;
+	for (int i = n-1; i >= 0; i--)
+		v = (v << 7) | (c[i] & 0x7f);
+	return v;
+}
+
+// open a value heap file
+// mode is "w" to create an empty heap, or as for openRelation
+
+Heap openHeap(char *name, char *mode)
+{
+	char fname[MAXFILENAME];
+	sprintf(fname,"%s.heap",name);
+	Heap h = malloc(sizeof(struct HeapRep));
+	assert(h != NULL);
+	if (mode[0] == 'w')
+		h->fd = open(fname, O_RDWR|O_CREAT|O_TRUNC, 0644);
+	else
+		h->fd = open(fname, strchr(mode,'+') != NULL ? O_RDWR : O_RDONLY);
+	if (h->fd < 0) { free(h); return NULL; }
+	h->size = lseek(h->fd, 0, SEEK_END);
+	return h;
+}
+
+void closeHeap(Heap h)
+{
+	close(h->fd);
+	free(h);
+}
+
+// is a value of len bytes stored out of line?
+// (values that look like references are, too)
+
+Bool outOfLine(char *val, Count len)
+{
+	return len > INLINEMAX || val[0] == HEAPREF;
+}
+
+// reference prefix for a value with this hash and length
+// returns its length (PREFLEN)
+
+Count heapRefPrefix(Bits hash, Count len, char *ref)
+{
+	char *c = ref;
+	*c++ = HEAPREF;
+	c = put7(c, hash, 5);
+	c = put7(c, len, 3);
+	return c - ref;
+}
+
+// append a value to the heap, and put its reference in ref
+// returns the reference's length (REFLEN)
+
+Count heapPut(Heap h, char *val, Count len, Bits hash, char *ref)
+{
+	assert(len < (1 << 21) && h->size < (1LL << 35));
+	char *c = ref + heapRefPrefix(hash, len, ref);
+	c = put7(c, h->size, 5);
+	*c++ = '\0';
+	if (pwrite(h->fd, val, len, h->size) != len)
+		fatal("Can't write value heap");
+	h->size += len;
+	return c - ref;
+}
+
+// hash and length of the value a reference refers to
+
+void heapRefInfo(char *ref, Bits *hash, Count *len)
+{
+	*hash = get7(ref+1, 5);
+	*len = get7(ref+6, 3);
+}
+
+// fetch the value a reference refers to into buf, with a '\0'
+
+void heapGet(Heap h, char *ref, char *buf)
+{
+	Bits hash; Count len;
+	heapRefInfo(ref, &hash, &len);
+	long long off = get7(ref+PREFLEN, 5);
+	if (pread(h->fd, buf, len, off) != len) fatal("Can't read value heap");
+	buf[len] = '\0';
+}
+
+long long heapSize(Heap h) { return h->size; }
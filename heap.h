@@ -0,0 +1,26 @@
+// heap.h ... interface to out-of-line value storage
+// part of Multi-attribute Linear-hashed Files
+// See heap.c for details of Heap type and functions
+
+#ifndef HEAP_H
+#define HEAP_H 1
+
+typedef struct HeapRep *Heap;
+
+#include "defs.h"
+#include "bits.h"
+
+#define HEAPREF 0x01  // first byte of a reference field
+#define REFLEN  15    // bytes in a reference field, including '\0'
+#define PREFLEN 9     // bytes in a reference before the offset
+
+Heap openHeap(char *name, char *mode);
+void closeHeap(Heap h);
+Bool outOfLine(char *val, Count len);
+Count heapPut(Heap h, char *val, Count len, Bits hash, char *ref);
+Count heapRefPrefix(Bits hash, Count len, char *ref);
+void heapRefInfo(char *ref, Bits *hash, Count *len);
+void heapGet(Heap h, char *ref, char *buf);
+long long heapSize(Heap h);
+
+#endif
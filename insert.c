@@ -1,13 +1,18 @@
 // insert.c ... add tuples to a relation
 // part of Multi-attribute linear-hashed files
 // Reads tuples from stdin and inserts into Reln
-// Usage:  ./insert  [-v]  RelName
+// Usage:  ./insert  [-v]  [-d]  RelName
+// -d writes pages with O_DIRECT, bypassing the kernel page cache
+// If the relation has a key attribute, a tuple whose key value is
+//   already in the relation stops the insert
 
 #include "defs.h"
 #include "reln.h"
 #include "tuple.h"
+#include "query.h"
+#include <unistd.h>
 
-#define USAGE "./insert  [-v]  RelName"
+#define USAGE "./insert  [-v]  [-d]  RelName"
 
 // Main ... process args, read/insert tuples
 
@@ -16,17 +21,23 @@ int main(int argc, char **argv)
 	Reln r;  // handle on the open relation
 	Tuple t;  // tuple buffer
 	char err[2*MAXERRMSG];  // buffer for error messages
-	char tup[MAXTUPLEN];  // buffer for printable tuples
-	int verbose;  // show extra info on query progress
+	char tup[MAXLINE];  // buffer for printable tuples
+	int verbose = 0;  // show extra info on query progress
+	int direct = 0;  // use O_DIRECT for page I/O
 	char *rname;  // name of table/file
+	int opt;
 
 	// process command-line args
 
-	if (argc < 2) fatal(USAGE);
-    if (strcmp(argv[1], "-v") == 0)
-		{ verbose = 1; rname = argv[2]; }
-	else
-		{ verbose = 0; rname = argv[1]; }
+	while ((opt = getopt(argc, argv, "+vd")) != -1) {
+		switch (opt) {
+		case 'v': verbose = 1; break;
+		case 'd': direct = 1; break;
+		default:  fatal(USAGE);
+		}
+	}
+	if (optind >= argc) fatal(USAGE);
+	rname = argv[optind];
 
 
 	// set up relation for writing
@@ -35,29 +46,47 @@ int main(int argc, char **argv)
 		sprintf(err, "No such relation: %s", rname);
 		fatal(err);
 	}
-	if ((r = openRelation(rname,"r+")) == NULL) {
-		sprintf(err, "Can't open relation: %s",argv[1]);
+	if ((r = openRelation(rname, direct ? "r+d" : "r+")) == NULL) {
+		sprintf(err, "Can't open relation: %s",rname);
 		fatal(err);
 	}
 
 	// read stdin and insert tuples
 
-	while ((t = readTuple(r,stdin)) != NULL) {
+	// each tuple lives in the batch arena until it's been inserted
+	Arena batch = newArena();
+	int duplicate = 0;
+	int status;
+	while ((status = readTuple(r,stdin,batch,&t)) == READ_OK) {
 		PageID pid;
+		tupleString(t,tup); // printable version
+		if (keyAttr(r) != NO_KEY) {
+			Query q = startKeyQuery(r,t);
+			duplicate = (countQuery(q) > 0);
+			closeQuery(q);
+			if (duplicate) break;
+		}
 		pid = addToRelation(r,t);
 
-		tupleString(t,tup); // printable version
 		if (pid == NO_PAGE) {
-			sprintf(err, "Insert of %s failed\n", tup);
+			sprintf(err, "Insert of %.100s failed\n", tup);
 			fatal(err);
 		}
 		if (verbose) printf("%s -> %d\n",tup,pid);
-		free(t);
+		resetArena(batch);
 	}
+	freeArena(batch);
+	int invalid = (status == READ_BAD);
 
 	// clean up
 
 	closeRelation(r);
+	if (duplicate) {
+		sprintf(err, "Duplicate key: %.100s", tup);
+		fatal(err);
+	}
+	if (invalid)
+		fatal("Invalid tuple (wrong #attrs, bad integer or too long)");
 
 	return 0;
 }
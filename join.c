@@ -0,0 +1,80 @@
+// join.c ... equi-join two Relations
+// part of Multi-attribute linear-hashed files
+// Writes the tuples of R join S on R.a = S.b to stdout, each as
+//   R's values followed by S's values
+// Usage:  ./join  [-v]  [-g]  R  a  S  b
+// -v reports the join method used, on stderr
+// -g always uses a grace hash join
+
+#include "defs.h"
+#include "reln.h"
+#include "equijoin.h"
+#include <unistd.h>
+
+#define USAGE "./join  [-v]  [-g]  R  a  S  b"
+
+// open a relation for reading, or give up
+
+static Reln openOrFail(char *rname)
+{
+	char err[MAXERRMSG];
+	Reln r;
+	if (!existsRelation(rname) || (r = openRelation(rname,"r")) == NULL) {
+		sprintf(err, "Can't open relation: %.100s", rname);
+		fatal(err);
+	}
+	return r;
+}
+
+// check an attribute number
+
+static int attrOrFail(Reln r, char *att)
+{
+	char err[MAXERRMSG];
+	char *end;
+	long a = strtol(att, &end, 10);
+	if (end == att || *end != '\0' || a < 0 || a >= nattrs(r)) {
+		sprintf(err, "Invalid attribute: %.100s", att);
+		fatal(err);
+	}
+	return a;
+}
+
+// Main ... process args, run join
+
+int main(int argc, char **argv)
+{
+	int verbose = 0;  // report join method
+	int how = JOIN_ANY;  // join method
+	int opt;
+
+	// process command-line args
+
+	while ((opt = getopt(argc, argv, "+vg")) != -1) {
+		switch (opt) {
+		case 'v': verbose = 1; break;
+		case 'g': how = JOIN_GRACE; break;
+		default:  fatal(USAGE);
+		}
+	}
+	if (argc - optind < 4) fatal(USAGE);
+	Reln r = openOrFail(argv[optind]);
+	int a = attrOrFail(r, argv[optind+1]);
+	Reln s = openOrFail(argv[optind+2]);
+	int b = attrOrFail(s, argv[optind+3]);
+
+	// run join
+
+	int p = joinPartitionBits(r, a, s, b);
+	Count n = joinRelations(r, a, s, b, how, stdout);
+	if (verbose) {
+		if (how == JOIN_ANY && p > 0)
+			fprintf(stderr, "Partition-wise join on %d bits\n", p);
+		else
+			fprintf(stderr, "Grace hash join\n");
+		fprintf(stderr, "%d result tuples\n", n);
+	}
+	closeRelation(r);
+	closeRelation(s);
+	return 0;
+}
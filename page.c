@@ -5,6 +5,94 @@
 
 #include "defs.h"
 #include "page.h"
+#include "compress.h"
+#include "trace.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <pthread.h>
+
+// page buffers are aligned for O_DIRECT transfers
+#define PAGEALIGN 4096
+
+// read-ahead for O_DIRECT files: NAHEAD page buffers, filled by
+//  NREADERS background threads
+#define NAHEAD   16
+#define NREADERS 4
+
+// compressed pages are stored in slots that are a multiple of CSLOT
+//  bytes, with at least CSLACK bytes to spare, so a page can grow a
+//  little before it has to move to a bigger slot
+#define CSLOT  64
+#define CSLACK 64
+
+// where a page of a compressed file is stored
+// len == PAGESIZE means the page didn't compress and is stored as is
+typedef struct {
+	long long off;  // byte offset in file
+	Count len;      // bytes used
+	Count cap;      // bytes available
+} Slot;
+
+// an open file of pages
+// accessed only via positional reads/writes, so there is no shared
+//   file position, and several threads can use one File at once;
+//   the page count and (in a compressed file) the slot map are
+//   guarded by lock, as a write can add pages or move them
+// In a compressed file, each page is stored in a variable-size slot;
+//   the slots are located via a map kept in memory while the file
+//   is open, and in the file <name>.map, whose entry for a page is
+//   rewritten whenever the page is written, so it's never out of date
+//   even if the program stops without closing the file
+struct FileRep {
+	int  fd;       // file descriptor
+	Bool direct;   // opened with O_DIRECT (bypasses kernel cache)
+	Bool writable; // opened for writing
+	Bool compressed; // pages stored compressed, via map
+	char *name;    // file name (to find map file)
+	pthread_mutex_t lock; // guards map, npages, maxpages, end, garbage
+	Slot *map;     // compressed: location of each page
+	int  mapfd;    // compressed and writable: the map file (else -1)
+	Count npages;  // compressed: number of pages in map
+	               // otherwise: number of pages, for counting appends
+	Count maxpages; // compressed: allocated size of map
+	long long end; // compressed: end of space used in file
+	long long garbage; // compressed: bytes in abandoned slots
+	// counts, updated atomically, as readers may share the file
+	Count nreads;  // pages read
+	Count nwrites; // pages written (including appended ones)
+	Count nappends; // pages appended
+	struct ReadAhead *ra; // O_DIRECT: pages being read ahead (or NULL)
+};
+
+// O_DIRECT files bypass the kernel's cache, so the kernel can't read
+//   ahead for them; instead, prefetchPages queues reads that a few
+//   threads do with pread, each into its own page buffer, and
+//   getPage takes the buffer over when the page is wanted
+// a buffer no-one has asked for is reused for a later read-ahead,
+//   oldest first, and one for a page that's written is dropped
+typedef struct {
+	PageID pid;    // page in buf (NO_PAGE if slot is free)
+	Bool   done;   // the read has finished
+	Bool   ok;     // ... and read the whole page
+	Count  seq;    // when the read was queued
+	Page   buf;
+} Ahead;
+
+struct ReadAhead {
+	pthread_mutex_t lock;
+	pthread_cond_t  work;  // reads are queued (or stop is set)
+	pthread_cond_t  done;  // a read has finished
+	pthread_t reader[NREADERS];
+	int    nreaders;       // readers started (on the first read-ahead)
+	Bool   stop;
+	Ahead  slot[NAHEAD];
+	int    queue[NAHEAD];  // slots waiting for a reader, in order
+	Count  head, nqueued;
+	Count  seq;
+};
 
 // internal representation of pages
 struct PageRep {
@@ -19,14 +107,50 @@ struct PageRep {
 // - free is the offset of the first byte of free space
 // - ovflow is the page id of the next overflow page in bucket
 // - data[] is a sequence of bytes containing tuples
-// - each tuple is a sequence of chars terminated by '\0'
+// - each tuple is stored as a record (see tuple.c); for plain
+//   text relations, a sequence of chars terminated by '\0'
 // - PageID values count # pages from start of file
 
+// allocate a PAGESIZE buffer, aligned so that it can be used
+//  for O_DIRECT I/O; can be released with free()
+static void *pageBuffer(size_t size)
+{
+	void *buf = NULL;
+	int ok = posix_memalign(&buf, PAGEALIGN, size);
+	assert(ok == 0 && buf != NULL);
+	return buf;
+}
+
+// O_DIRECT transfers must be aligned to the device's logical block
+//   size, which may be bigger than a page; such files (and files on
+//   filesystems without direct I/O) use the page cache instead
+static int directOK(int fd)
+{
+#ifdef STATX_DIOALIGN
+	struct statx sx;
+	if (statx(fd, "", AT_EMPTY_PATH, STATX_DIOALIGN, &sx) == 0
+	    && (sx.stx_mask & STATX_DIOALIGN))
+		return sx.stx_dio_offset_align != 0
+		       && PAGESIZE % sx.stx_dio_offset_align == 0
+		       && PAGEALIGN % sx.stx_dio_mem_align == 0;
+#endif
+	return TRUE;
+}
+
+// if a direct transfer failed with EINVAL (alignment the kernel
+//   couldn't tell us about at open), switch the file to buffered I/O
+//   so that the caller can retry it
+static int undirect(File f)
+{
+	if (!f->direct || errno != EINVAL) return FALSE;
+	int flags = fcntl(f->fd, F_GETFL);
+	return flags >= 0 && fcntl(f->fd, F_SETFL, flags & ~O_DIRECT) == 0;
+}
+
 // create a new initially empty page in memory
 Page newPage()
 {
-	Page p = malloc(PAGESIZE);
-	assert(p != NULL);
+	Page p = pageBuffer(PAGESIZE);
 	p->free = 0;
 	p->ovflow = NO_PAGE;
 	p->ntuples = 0;
@@ -36,63 +160,573 @@ Page newPage()
 	return p;
 }
 
-// append a new Page to a file; return its PageID
-PageID addPage(FILE *f)
+// background reader for an O_DIRECT file
+
+static void *readAhead(void *arg)
+{
+	File f = arg;
+	struct ReadAhead *ra = f->ra;
+	pthread_mutex_lock(&ra->lock);
+	for (;;) {
+		while (ra->nqueued == 0 && !ra->stop)
+			pthread_cond_wait(&ra->work, &ra->lock);
+		if (ra->stop) break;
+		Ahead *a = &ra->slot[ra->queue[ra->head]];
+		ra->head = (ra->head+1) % NAHEAD;
+		ra->nqueued--;
+		pthread_mutex_unlock(&ra->lock);
+		ssize_t n = pread(f->fd, a->buf, PAGESIZE, (off_t)a->pid*PAGESIZE);
+		if (n < 0 && undirect(f))
+			n = pread(f->fd, a->buf, PAGESIZE, (off_t)a->pid*PAGESIZE);
+		pthread_mutex_lock(&ra->lock);
+		a->ok = (n == PAGESIZE);
+		a->done = TRUE;
+		pthread_cond_broadcast(&ra->done);
+	}
+	pthread_mutex_unlock(&ra->lock);
+	return NULL;
+}
+
+// set up read-ahead for an O_DIRECT file
+// the readers aren't started until something is to be read ahead, so
+//   a file that's only written costs no threads
+
+static void initReadAhead(File f)
+{
+	struct ReadAhead *ra = malloc(sizeof(struct ReadAhead));
+	assert(ra != NULL);
+	pthread_mutex_init(&ra->lock, NULL);
+	pthread_cond_init(&ra->work, NULL);
+	pthread_cond_init(&ra->done, NULL);
+	ra->stop = FALSE;
+	for (int i = 0; i < NAHEAD; i++) ra->slot[i].pid = NO_PAGE;
+	ra->head = ra->nqueued = ra->seq = 0;
+	ra->nreaders = 0;
+	f->ra = ra;
+}
+
+// start a file's readers; caller holds the read-ahead lock, so only
+//   one of the threads sharing the file starts them
+
+static void startReaders(File f)
+{
+	struct ReadAhead *ra = f->ra;
+	for (int i = 0; i < NREADERS; i++) {
+		int ok = pthread_create(&ra->reader[i], NULL, readAhead, f);
+		assert(ok == 0);
+	}
+	ra->nreaders = NREADERS;
+}
+
+static void stopReadAhead(File f)
+{
+	struct ReadAhead *ra = f->ra;
+	if (ra == NULL) return;
+	pthread_mutex_lock(&ra->lock);
+	ra->stop = TRUE;
+	pthread_cond_broadcast(&ra->work);
+	pthread_mutex_unlock(&ra->lock);
+	for (int i = 0; i < ra->nreaders; i++) pthread_join(ra->reader[i], NULL);
+	for (int i = 0; i < NAHEAD; i++)
+		if (ra->slot[i].pid != NO_PAGE) free(ra->slot[i].buf);
+	pthread_mutex_destroy(&ra->lock);
+	pthread_cond_destroy(&ra->work);
+	pthread_cond_destroy(&ra->done);
+	free(ra);
+	f->ra = NULL;
+}
+
+// the read-ahead slot for page pid (NULL if none); caller holds lock
+
+static Ahead *aheadSlot(struct ReadAhead *ra, PageID pid)
+{
+	for (int i = 0; i < NAHEAD; i++)
+		if (ra->slot[i].pid == pid) return &ra->slot[i];
+	return NULL;
+}
+
+// queue a read of page pid, in a free slot or the oldest unclaimed
+//   finished one; the hint is dropped if every slot is busy
+
+static void queueAhead(struct ReadAhead *ra, PageID pid)
+{
+	if (aheadSlot(ra, pid) != NULL) return;
+	int k = -1;
+	for (int i = 0; i < NAHEAD; i++) {
+		Ahead *a = &ra->slot[i];
+		if (a->pid == NO_PAGE) { k = i; break; }
+		if (a->done && (k < 0 || a->seq < ra->slot[k].seq)) k = i;
+	}
+	if (k < 0) return;
+	Ahead *a = &ra->slot[k];
+	if (a->pid == NO_PAGE) a->buf = pageBuffer(PAGESIZE);
+	a->pid = pid;
+	a->done = a->ok = FALSE;
+	a->seq = ra->seq++;
+	ra->queue[(ra->head + ra->nqueued) % NAHEAD] = k;
+	ra->nqueued++;
+	pthread_cond_signal(&ra->work);
+}
+
+// take page pid out of the read-ahead slots, waiting for its read
+//   to finish; returns its buffer if it was read ahead, otherwise
+//   NULL (and the buffer is dropped)
+
+static Page claimAhead(File f, PageID pid)
+{
+	struct ReadAhead *ra = f->ra;
+	if (ra == NULL) return NULL;
+	pthread_mutex_lock(&ra->lock);
+	// the slot is looked up again after each wait, as another thread
+	//   may have claimed it, or reused it for another page, meanwhile
+	Ahead *a;
+	while ((a = aheadSlot(ra, pid)) != NULL && !a->done)
+		pthread_cond_wait(&ra->done, &ra->lock);
+	Page p = NULL;
+	if (a != NULL) {
+		p = a->buf;
+		if (!a->ok) { free(p); p = NULL; }
+		a->pid = NO_PAGE;
+	}
+	pthread_mutex_unlock(&ra->lock);
+	return p;
+}
+
+// load the slot map of a compressed file from <name>.map
+static void readMap(File f)
+{
+	char mname[MAXFILENAME];
+	sprintf(mname,"%s.map",f->name);
+	f->npages = f->maxpages = 0;
+	f->map = NULL;
+	f->end = f->garbage = 0;
+	FILE *m = fopen(mname,"r");
+	if (m == NULL) return;
+	fseek(m, 0, SEEK_END);
+	f->npages = f->maxpages = ftell(m)/sizeof(Slot);
+	fseek(m, 0, SEEK_SET);
+	f->map = malloc(f->maxpages*sizeof(Slot) + 1);
+	assert(f->map != NULL);
+	int n = fread(f->map, sizeof(Slot), f->npages, m);
+	assert(n == f->npages);
+	fclose(m);
+	long long used = 0;
+	for (Count i = 0; i < f->npages; i++) {
+		Slot *s = &f->map[i];
+		if (s->off + s->cap > f->end) f->end = s->off + s->cap;
+		used += s->cap;
+	}
+	f->garbage = f->end - used;
+}
+
+// save the entry for page pid in a compressed file's map file
+static void writeSlot(File f, PageID pid)
+{
+	ssize_t n = pwrite(f->mapfd, &f->map[pid], sizeof(Slot),
+	                   (off_t)pid*sizeof(Slot));
+	assert(n == sizeof(Slot));
+}
+
+// save the whole slot map of a compressed file
+static void writeMap(File f)
+{
+	if (f->npages > 0) {
+		ssize_t n = pwrite(f->mapfd, f->map, f->npages*sizeof(Slot), 0);
+		assert(n == f->npages*sizeof(Slot));
+	}
+	int ok = ftruncate(f->mapfd, (off_t)f->npages*sizeof(Slot));
+	assert(ok == 0);
+}
+
+// rewrite a compressed file with its slots packed in page order,
+//  dropping the space of slots abandoned when pages grew
+static void compactFile(File f)
+{
+	char tname[MAXFILENAME];
+	sprintf(tname,"%s.tmp",f->name);
+	int fd = open(tname, O_RDWR|O_CREAT|O_TRUNC, 0644);
+	assert(fd >= 0);
+	char buf[PAGESIZE];
+	long long end = 0;
+	for (Count i = 0; i < f->npages; i++) {
+		Slot *s = &f->map[i];
+		ssize_t n = pread(f->fd, buf, s->len, s->off);
+		assert(n == s->len);
+		n = pwrite(fd, buf, s->len, end);
+		assert(n == s->len);
+		s->off = end;
+		s->cap = (s->len + CSLOT-1) / CSLOT * CSLOT;
+		if (s->cap > PAGESIZE) s->cap = PAGESIZE;
+		end += s->cap;
+	}
+	int ok = rename(tname, f->name);
+	assert(ok == 0);
+	close(f->fd);
+	f->fd = fd;
+	f->end = end;
+	f->garbage = 0;
+	writeMap(f);
+}
+
+// open a file of pages
+// mode is as for fopen ("r", "r+", "w"), plus optional
+//  'd' to request O_DIRECT, for callers that do their own caching;
+//     if the file system can't do direct I/O, fall back to normal I/O
+//  'z' to store pages compressed (which excludes O_DIRECT)
+File openFile(char *name, char *mode)
+{
+	int flags;
+	if (mode[0] == 'w')
+		flags = O_RDWR|O_CREAT|O_TRUNC;
+	else if (strchr(mode,'+') != NULL)
+		flags = O_RDWR;
+	else
+		flags = O_RDONLY;
+	File f = malloc(sizeof(struct FileRep));
+	assert(f != NULL);
+	f->writable = (flags != O_RDONLY);
+	f->compressed = (strchr(mode,'z') != NULL);
+	f->direct = (strchr(mode,'d') != NULL) && !f->compressed;
+	f->fd = open(name, f->direct ? flags|O_DIRECT : flags, 0644);
+	if (f->fd < 0 && f->direct && errno == EINVAL) {
+		f->direct = FALSE;
+		f->fd = open(name, flags, 0644);
+	}
+	if (f->fd < 0) { free(f); return NULL; }
+	if (f->direct && !directOK(f->fd)) {
+		f->direct = FALSE;
+		fcntl(f->fd, F_SETFL, fcntl(f->fd, F_GETFL) & ~O_DIRECT);
+	}
+	f->name = copyString(name);
+	pthread_mutex_init(&f->lock, NULL);
+	f->map = NULL;
+	f->mapfd = -1;
+	f->nreads = f->nwrites = f->nappends = 0;
+	f->ra = NULL;
+	if (f->direct) initReadAhead(f);
+	if (f->compressed) {
+		readMap(f);
+		if (mode[0] == 'w') { f->npages = 0; f->end = f->garbage = 0; }
+		if (f->writable) {
+			char mname[MAXFILENAME];
+			sprintf(mname,"%s.map",name);
+			f->mapfd = open(mname, (mode[0] == 'w')
+			                ? O_RDWR|O_CREAT|O_TRUNC : O_RDWR|O_CREAT, 0644);
+			assert(f->mapfd >= 0);
+		}
+	}
+	else
+		f->npages = filePages(f);
+	return f;
+}
+
+// close a file of pages and release its handle
+// a compressed file is compacted first if most of it is garbage
+void closeFile(File f)
 {
-	int ok = fseek(f, 0, SEEK_END);
+	if (f->compressed && f->writable) {
+		if (f->garbage > f->end/2) compactFile(f);
+		close(f->mapfd);
+	}
+	stopReadAhead(f);
+	close(f->fd);
+	pthread_mutex_destroy(&f->lock);
+	free(f->map);
+	free(f->name);
+	free(f);
+}
+
+// number of Pages currently in a file
+Count filePages(File f)
+{
+	if (f->compressed) {
+		pthread_mutex_lock(&f->lock);
+		Count n = f->npages;
+		pthread_mutex_unlock(&f->lock);
+		return n;
+	}
+	struct stat st;
+	int ok = fstat(f->fd, &st);
 	assert(ok == 0);
-	int pos = ftell(f);
-	assert(pos >= 0);
-	PageID pid = pos/PAGESIZE;
+	return st.st_size/PAGESIZE;
+}
+
+// bytes of data that a scan of every page in the file would need
+//  to read, and the bytes that holding them uncompressed would take
+void fileUsage(File f, long long *stored, long long *logical)
+{
+	*logical = (long long)filePages(f)*PAGESIZE;
+	*stored = *logical;
+	if (!f->compressed) return;
+	*stored = 0;
+	pthread_mutex_lock(&f->lock);
+	for (Count i = 0; i < f->npages; i++) *stored += f->map[i].len;
+	pthread_mutex_unlock(&f->lock);
+}
+
+// number of Pages read, written and appended since the file was opened
+void fileCounts(File f, Count *reads, Count *writes, Count *appends)
+{
+	*reads = __atomic_load_n(&f->nreads, __ATOMIC_RELAXED);
+	*writes = __atomic_load_n(&f->nwrites, __ATOMIC_RELAXED);
+	*appends = __atomic_load_n(&f->nappends, __ATOMIC_RELAXED);
+}
+
+// append a new Page to a file; return its PageID
+PageID addPage(File f)
+{
+	PageID pid = filePages(f);
 	Page p = newPage();
-	ok = putPage(f, pid, p);
+	int ok = putPage(f, pid, p);
 	assert(ok == 0);
 	return pid;
 }
 
+// append an extent of n adjacent new Pages to a file in one write
+// the first page is ready for use; the others are marked RESERVED
+//  (via their ovflow field) until they are linked into a chain
+// return PageID of the first page in the extent
+PageID addExtent(File f, Count n)
+{
+	assert(n >= 1);
+	PageID pid = filePages(f);
+	if (f->compressed) {
+		// slots are appended in order, so they're adjacent anyway
+		for (Count i = 0; i < n; i++) {
+			Page p = newPage();
+			if (i > 0) p->ovflow = RESERVED;
+			putPage(f, pid+i, p);
+		}
+		return pid;
+	}
+	char *buf = pageBuffer(n*PAGESIZE);
+	for (Count i = 0; i < n; i++) {
+		Page old = claimAhead(f, pid+i);
+		if (old != NULL) free(old);
+		Page p = newPage();
+		if (i > 0) p->ovflow = RESERVED;
+		memcpy(buf + i*PAGESIZE, p, PAGESIZE);
+		free(p);
+	}
+	ssize_t nw = pwrite(f->fd, buf, n*PAGESIZE, (off_t)pid*PAGESIZE);
+	if (nw < 0 && undirect(f))
+		nw = pwrite(f->fd, buf, n*PAGESIZE, (off_t)pid*PAGESIZE);
+	assert(nw == n*PAGESIZE);
+	__atomic_fetch_add(&f->nwrites, n, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&f->nappends, n, __ATOMIC_RELAXED);
+	pthread_mutex_lock(&f->lock);
+	f->npages = pid + n;
+	pthread_mutex_unlock(&f->lock);
+	free(buf);
+	return pid;
+}
+
 // fetch a Page from a file; allocate a memory buffer
-Page getPage(FILE *f, PageID pid)
+// pages in compressed files are decompressed on the way in
+static Page readPage(File f, PageID pid)
 {
-	assert(pid >= 0);
-	Page p = malloc(PAGESIZE);
-	assert(p != NULL);
-	int ok = fseek(f, pid*PAGESIZE, SEEK_SET);
-	assert(ok == 0);
-	int n = fread(p, 1, PAGESIZE, f);
-	//printf("%d\n",n);
-	assert(n == PAGESIZE);
+	assert(pid != NO_PAGE);
+	__atomic_fetch_add(&f->nreads, 1, __ATOMIC_RELAXED);
+	Page p = claimAhead(f, pid);
+	if (p != NULL) return p;
+	p = pageBuffer(PAGESIZE);
+	if (!f->compressed) {
+		ssize_t n = pread(f->fd, p, PAGESIZE, (off_t)pid*PAGESIZE);
+		if (n < 0 && undirect(f))
+			n = pread(f->fd, p, PAGESIZE, (off_t)pid*PAGESIZE);
+		assert(n == PAGESIZE);
+		return p;
+	}
+	pthread_mutex_lock(&f->lock);
+	assert(pid < f->npages);
+	Slot slot = f->map[pid], *s = &slot;
+	pthread_mutex_unlock(&f->lock);
+	if (s->len == PAGESIZE) {
+		ssize_t n = pread(f->fd, p, PAGESIZE, s->off);
+		assert(n == PAGESIZE);
+		return p;
+	}
+	char buf[PAGESIZE];
+	ssize_t n = pread(f->fd, buf, s->len, s->off);
+	assert(n == s->len);
+	int len = lzDecompress(buf, s->len, (char *)p, PAGESIZE);
+	assert(len == PAGESIZE);
 	return p;
 }
 
 // write a Page to a file; release allocated buffer
-Status putPage(FILE *f, PageID pid, Page p)
+// in a compressed file, the page is compressed and stays in its slot
+//  if it fits; otherwise, it moves to a new slot at the end of file
+//  (a PageID one past the last page appends a new page)
+static Status writePage(File f, PageID pid, Page p)
 {
-	assert(pid >= 0);
-	int ok = fseek(f, pid*PAGESIZE, SEEK_SET);
-	assert(ok == 0);
-	int n = fwrite(p, 1, PAGESIZE, f);
-	assert(n == PAGESIZE);
+	assert(pid != NO_PAGE);
+	__atomic_fetch_add(&f->nwrites, 1, __ATOMIC_RELAXED);
+	if (!f->compressed) {
+		// a copy read ahead would be out of date
+		Page old = claimAhead(f, pid);
+		if (old != NULL) free(old);
+		ssize_t n = pwrite(f->fd, p, PAGESIZE, (off_t)pid*PAGESIZE);
+		if (n < 0 && undirect(f))
+			n = pwrite(f->fd, p, PAGESIZE, (off_t)pid*PAGESIZE);
+		assert(n == PAGESIZE);
+		pthread_mutex_lock(&f->lock);
+		if (pid >= f->npages) {
+			__atomic_fetch_add(&f->nappends, pid+1 - f->npages,
+			                   __ATOMIC_RELAXED);
+			f->npages = pid+1;
+		}
+		pthread_mutex_unlock(&f->lock);
+		free(p);
+		return 0;
+	}
+	char buf[PAGESIZE];
+	char *src = buf;
+	int len = lzCompress((char *)p, PAGESIZE, buf, PAGESIZE-1);
+	if (len < 0) { src = (char *)p; len = PAGESIZE; }
+	pthread_mutex_lock(&f->lock);
+	assert(pid <= f->npages);
+	if (pid == f->npages) {
+		if (f->npages == f->maxpages) {
+			f->maxpages = (f->maxpages == 0) ? 64 : 2*f->maxpages;
+			f->map = realloc(f->map, f->maxpages*sizeof(Slot));
+			assert(f->map != NULL);
+		}
+		f->npages++;
+		__atomic_fetch_add(&f->nappends, 1, __ATOMIC_RELAXED);
+		f->map[pid].cap = 0;
+	}
+	Slot *s = &f->map[pid];
+	if (len > s->cap) {
+		f->garbage += s->cap;
+		s->off = f->end;
+		s->cap = (len + CSLACK + CSLOT-1) / CSLOT * CSLOT;
+		if (s->cap > PAGESIZE) s->cap = PAGESIZE;
+		f->end += s->cap;
+	}
+	s->len = len;
+	ssize_t n = pwrite(f->fd, src, len, s->off);
+	assert(n == len);
+	writeSlot(f, pid);
+	pthread_mutex_unlock(&f->lock);
 	free(p);
 	return 0;
 }
 
-// insert a tuple into a page
+// timed versions of the above (see trace.c)
+
+Page getPage(File f, PageID pid)
+{
+	long long t = traceStart();
+	Page p = readPage(f, pid);
+	traceEnd(OP_READ, t, pid);
+	return p;
+}
+
+Status putPage(File f, PageID pid, Page p)
+{
+	long long t = traceStart();
+	Status s = writePage(f, pid, p);
+	traceEnd(OP_WRITE, t, pid);
+	return s;
+}
+
+// hint that n Pages starting at pid will be read soon
+// the kernel starts reading them in the background, so that a
+//   later getPage() finds them in memory instead of waiting on I/O
+// for an O_DIRECT file, the pages are read ahead by its own threads
+//   instead (up to NAHEAD of them at a time)
+void prefetchPages(File f, PageID pid, Count n)
+{
+	if (pid == NO_PAGE || n == 0) return;
+	if (f->direct) {
+		pthread_mutex_lock(&f->ra->lock);
+		if (f->ra->nreaders == 0) startReaders(f);
+		for (Count i = 0; i < n && i < NAHEAD; i++)
+			queueAhead(f->ra, pid+i);
+		pthread_mutex_unlock(&f->ra->lock);
+		return;
+	}
+	if (!f->compressed) {
+		posix_fadvise(f->fd, (off_t)pid*PAGESIZE, (off_t)n*PAGESIZE,
+		              POSIX_FADV_WILLNEED);
+		return;
+	}
+	pthread_mutex_lock(&f->lock);
+	for (PageID i = pid; i < pid+n && i < f->npages; i++)
+		posix_fadvise(f->fd, f->map[i].off, f->map[i].len,
+		              POSIX_FADV_WILLNEED);
+	pthread_mutex_unlock(&f->lock);
+}
+
+// insert a tuple record of n bytes into a page
 // returns 0 status if successful
 // returns -1 if not enough room
-Status addToPage(Page p, Tuple t)
+Status addToPage(Page p, char *rec, Count n)
 {
-	int n = tupLength(t);
 	char *c = p->data + p->free;
 	Count hdr_size = 2*sizeof(Offset) + sizeof(Count);
 	// doesn't fit ... return fail code
 	// assume caller will put it elsewhere
-	if (c+n > &p->data[PAGESIZE-hdr_size-2]) return -1;
-	strcpy(c, t);
-	p->free += n+1;
+	if (c+n > &p->data[PAGESIZE-hdr_size-1]) return -1;
+	memcpy(c, rec, n);
+	p->free += n;
 	p->ntuples++;
 	return OK;
 }
 
+// PAX layout (used in relations created with RELN_PAX)
+// data[] starts with a directory of end offsets, one per attribute;
+//   minipage i holds the fields of attribute i for all of the page's
+//   tuples, in tuple order, and runs from the end of minipage i-1
+//   (or the end of the directory) to its own end offset
+// free == 0 means the directory hasn't been set up (empty page)
+
+typedef unsigned short MiniOffset;
+
+static void paxInit(Page p, Count na)
+{
+	MiniOffset *end = (MiniOffset *)p->data;
+	for (Count i = 0; i < na; i++) end[i] = na*sizeof(MiniOffset);
+	p->free = na*sizeof(MiniOffset);
+}
+
+// insert a tuple, given as its na fields, into a PAX page
+// each field is appended to its minipage, shifting later minipages
+// returns 0 status if successful
+// returns -1 if not enough room
+Status addFieldsToPage(Page p, Count na, char **fields, Count *lens)
+{
+	Count hdr_size = 2*sizeof(Offset) + sizeof(Count);
+	if (p->free == 0) paxInit(p, na);
+	MiniOffset *end = (MiniOffset *)p->data;
+	Count need = 0;
+	for (Count i = 0; i < na; i++) need += lens[i];
+	if (p->free + need > PAGESIZE-hdr_size-1) return -1;
+	// work backwards, so minipages move only into space already moved from
+	Count shift = need;
+	for (int i = na-1; i >= 0; i--) {
+		shift -= lens[i];
+		Count start = (i == 0) ? na*sizeof(MiniOffset) : end[i-1];
+		memmove(p->data + start + shift, p->data + start, end[i] - start);
+		memcpy(p->data + end[i] + shift, fields[i], lens[i]);
+		end[i] += shift + lens[i];
+	}
+	p->free += need;
+	p->ntuples++;
+	return OK;
+}
+
+// start of minipage att in a PAX page; its size goes in *size
+char *pageMinipage(Page p, Count na, int att, Count *size)
+{
+	if (p->free == 0) { *size = 0; return p->data; }
+	MiniOffset *end = (MiniOffset *)p->data;
+	Count start = (att == 0) ? na*sizeof(MiniOffset) : end[att-1];
+	*size = end[att] - start;
+	return p->data + start;
+}
+
 // extract page info
 char *pageData(Page p) { return p->data; }
 Count pageNTuples(Page p) { return p->ntuples; }
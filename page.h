@@ -6,15 +6,25 @@
 #define PAGE_H 1
 
 typedef struct PageRep *Page;
+typedef struct FileRep *File;
 
 #include "defs.h"
 #include "tuple.h"
 
 Page newPage();
-PageID addPage(FILE *);
-Page getPage(FILE *, PageID);
-Status putPage(FILE *, PageID, Page);
-Status addToPage(Page, Tuple);
+File openFile(char *, char *);
+void closeFile(File);
+Count filePages(File);
+void fileUsage(File, long long *, long long *);
+void fileCounts(File, Count *, Count *, Count *);
+PageID addPage(File);
+PageID addExtent(File, Count);
+Page getPage(File, PageID);
+Status putPage(File, PageID, Page);
+void prefetchPages(File, PageID, Count);
+Status addToPage(Page, char *, Count);
+Status addFieldsToPage(Page, Count, char **, Count *);
+char *pageMinipage(Page, Count, int, Count *);
 char *pageData(Page);
 Count pageNTuples(Page);
 Offset pageOvflow(Page);
@@ -5,233 +5,1138 @@
 #include "defs.h"
 #include "query.h"
 #include "reln.h"
+#include "page.h"
 #include "hash.h"
+#include "heap.h"
+#include "trace.h"
+#include "arena.h"
 #include <stdlib.h>
+#include <time.h>
+#include <math.h>
 
 
 #include "tuple.h"
 
-// A suggestion ... you can change however you like
+// the values a query gives for one attribute: a single value, or
+//   those of an IN-list "v1|v2|..."; a value that can't occur (not in
+//   the dictionary, or not an integer) is left out
+// the values are in a hash set, keyed on the same hash that places
+//   tuples in buckets, so a field is looked up by its stored hash
+
+typedef struct {
+    Count   n;        // number of values
+    char  **vals;     // the values, as given
+    Count  *lens;     // lengths of ATT_TEXT values
+    Bits   *hashes;   // hashes of values
+    Count  *ids;      // dictionary ids of ATT_DICT values
+    long long *ints;  // values of integer values
+    Count   nslots;   // size of slots[] (a power of 2)
+    Count  *slots;    // indexes of values (NO_ID if slot is empty)
+} ValueSet;
 
 struct QueryRep {
     Reln    rel;       // need to remember Relation info
     Bits    known;     // the hash value from MAH
     Bits    unknown;   // the unknown bits from MAH
     PageID  curpage;   // current page in scan
-    int     is_ovflow; // are we in the overflow pages?
+    PageID  is_ovflow; // current overflow page (NO_PAGE if in data page)
     Offset  curtup;    // offset of current tuple within page
     Offset  curdata;   // offset of current tuple within page
-    char **vals;
+    Page    page;      // buffer holding current page (NULL if none)
+    Bits    cand;      // depth-bit hash value of current candidate
+    int     half;      // which of cand's buckets if it has been split
+    Bits    pfcand;    // prefetch frontier: PREFETCH candidates ahead
+    int     pfhalf;
+    Bool    empty;     // a query value can't occur => no results
+    ValueSet sets[MAXATTRS]; // values of known attributes
+    PageID *buckets;   // IN-lists: sorted candidate buckets (else NULL)
+    Count   nbuckets;
+    Count   limit;     // scan stops after this many matches
+    Count   nfound;    // matches so far
+    Count   nbread;    // stats: buckets scanned
+    Count   ndread;    // stats: data pages read
+    Count   noread;    // stats: overflow pages read
+    Count   ntread;    // stats: tuples in pages read
+    Bool    analyze;   // time the scan (see analyzeQuery)
+    double  tstart;    // time when query was set up
+    double  tplan;     // time taken to set up query
+    double  tscan;     // time spent scanning
+    int     drive;     // PAX: single-valued known attribute searched
+                       //   first (-1 if none)
+    char    needle[MAXRECLEN]; // PAX: drive's value in field form
+    Count   nlen;      // PAX: length of needle
+    char   *field[MAXATTRS];  // PAX: current field in each minipage
+    Count   fidx[MAXATTRS];   // PAX: tuple index of field[i]
+    char   *dend;      // PAX: end of drive's minipage
+    char    rec[MAXRECLEN]; // PAX: matching record, assembled
     int *unknown_flags;
-    //TODO
+    Arena   arena;     // everything allocated for the query
+    Tuple   tuple;     // buffer for getNextTuple's result
+    struct ViewPin *pin; // pins on the current page (NULL if none)
 };
-Tuple getTupleInPage(Query q);
-// take a query string (e.g. "1234,?,abc,?")
-// set up a QueryRep object for the scan
 
-Query startQuery(Reln r, char *q)
+// a page buffer held by pinned views; it's freed once the scan has
+//   moved off the page and every view on it has been released
+// a PAX record is assembled outside the page, so it's copied into
+//   the pin instead (page is NULL and the record follows the pin)
+
+struct ViewPin {
+    Page    page;
+    Count   refs;      // views, plus one while it's the scan's page
+};
+static char *getRecordInPage(Query q);
+
+// current time in seconds, for analyze mode
+
+static double now(void)
 {
-    int attr = nattrs(r);
-    int counter = 0;
-    for(int i = 0;i<strlen(q);i++){
-        if(q[i]==','){
-            counter++;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+// mask for the lower n bits of a hash (n may be 0)
+
+static Bits lowMask(int n)
+{
+    return (n >= MAXBITS) ? ~0 : ((Bits)1 << n) - 1;
+}
+
+// Candidate buckets are enumerated as depth-bit values, with the
+// known bits fixed and the unknown bits counting upwards.
+// A value below the split pointer stands for a bucket that has been
+// split, so it covers bucket cand+2^d too, or only that one if
+// bit d of the hash is known to be 1.
+
+static int candBuckets(Query q, Bits cand)
+{
+    Count d = depth(q->rel);
+    if (cand >= splitp(q->rel)) return 1;
+    return bitIsSet(q->unknown,d) ? 2 : 1;
+}
+
+static PageID candBucket(Query q, Bits cand, int half)
+{
+    Count d = depth(q->rel);
+    if (cand >= splitp(q->rel)) return cand;
+    if (bitIsSet(q->unknown,d)) return half ? cand+((Bits)1<<d) : cand;
+    return cand | (q->known & ((Bits)1<<d));
+}
+
+// step (cand,half) on to the next candidate bucket
+// returns its PageID, or NO_PAGE if there are no more
+// with a list of candidate buckets, cand is a position in the list
+
+static PageID nextCandidate(Query q, Bits *cand, int *half)
+{
+    if (q->buckets != NULL) {
+        if (*cand+1 >= q->nbuckets) return NO_PAGE;
+        return q->buckets[++*cand];
+    }
+    if (*half == 0 && candBuckets(q,*cand) == 2) {
+        *half = 1;
+        return candBucket(q,*cand,1);
+    }
+    Bits u = q->unknown & lowMask(depth(q->rel));
+    Bits next = (((*cand & u) | ~u) + 1) & u;
+    next |= *cand & ~u;
+    // wrapped around => all values of unknown bits seen
+    if (next <= *cand) return NO_PAGE;
+    *cand = next; *half = 0;
+    return candBucket(q,next,0);
+}
+
+// are two values in a value set the same?
+
+static Bool sameValue(ValueSet *vs, Byte enc, Count j, Count k)
+{
+    if (enc == ATT_DICT) return vs->ids[j] == vs->ids[k];
+    if (fieldWidth(enc) > 0) return vs->ints[j] == vs->ints[k];
+    return strcmp(vs->vals[j], vs->vals[k]) == 0;
+}
+
+// set up the value set for attribute i from s, which is "v1|v2|..."
+//   if list is set, or else a single value (allocated in arena a)
+
+static void makeValueSet(Reln r, int i, char *s, Bool list, ValueSet *vs,
+                         Arena a)
+{
+    Byte enc = attrEncoding(r,i);
+    Count max = 1;
+    for (char *c = s; list && *c != '\0'; c++)
+        if (*c == '|') max++;
+    vs->n = 0;
+    vs->vals = arenaAlloc(a, max*sizeof(char *));
+    vs->lens = arenaAlloc(a, max*sizeof(Count));
+    vs->hashes = arenaAlloc(a, max*sizeof(Bits));
+    vs->ids = arenaAlloc(a, max*sizeof(Count));
+    vs->ints = arenaAlloc(a, max*sizeof(long long));
+    // keep hash set at most half full
+    for (vs->nslots = 2; vs->nslots < 2*max; vs->nslots *= 2) ;
+    vs->slots = arenaAlloc(a, vs->nslots*sizeof(Count));
+    for (Count j = 0; j < vs->nslots; j++) vs->slots[j] = NO_ID;
+
+    Count mask = vs->nslots-1;
+    char *c = s;
+    for (;;) {
+        char *end = list ? strchr(c, '|') : NULL;
+        Count len = (end == NULL) ? strlen(c) : end - c;
+        Count k = vs->n;
+        char *val = arenaAlloc(a, len+1);
+        memcpy(val, c, len);
+        val[len] = '\0';
+        vs->vals[k] = val;
+        vs->lens[k] = len;
+        vs->hashes[k] = attrHash(r,i,val);
+        vs->ids[k] = NO_ID;
+        Bool ok = TRUE;
+        if (enc == ATT_DICT) {
+            vs->ids[k] = dictLookup(relnDict(r), i, val);
+            ok = (vs->ids[k] != NO_ID);
+        }
+        else if (fieldWidth(enc) > 0)
+            ok = (parseInt(enc, val, &vs->ints[k]) == OK);
+        Count slot = vs->hashes[k] & mask;
+        for (; ok && vs->slots[slot] != NO_ID; slot = (slot+1) & mask) {
+            Count j = vs->slots[slot];
+            if (vs->hashes[j] == vs->hashes[k] && sameValue(vs, enc, j, k))
+                ok = FALSE;  // a repeat
         }
+        if (ok) {
+            vs->slots[slot] = k;
+            vs->n++;
+        }
+        if (end == NULL) break;
+        c = end+1;
     }
-    if (counter!= attr-1){
-        return NULL;
+}
+
+static int cmpPageID(const void *a, const void *b)
+{
+    PageID x = *(PageID *)a, y = *(PageID *)b;
+    return (x > y) - (x < y);
+}
+
+// with IN-lists, the candidates are the buckets of every combination
+//   of values; they're collected in a sorted list without repeats,
+//   so each bucket is scanned once
+// only bits 0..d of a hash choose its bucket, and they come from a
+//   few attributes, so each attribute gives just a few distinct bit
+//   patterns, and the combinations of those are enumerated
+
+static void listCandidates(Query q)
+{
+    Reln r = q->rel;
+    Count d = depth(r), na = nattrs(r);
+    ChVecItem *cv = chvec(r);
+    Bits *pats[MAXATTRS];
+    Count npats[MAXATTRS], at[MAXATTRS];
+    for (int i = 0; i < na; i++) {
+        ValueSet *vs = &q->sets[i];
+        npats[i] = 1; at[i] = 0;
+        pats[i] = arenaAlloc(q->arena, ((vs->n > 0) ? vs->n : 1)*sizeof(Bits));
+        pats[i][0] = 0;
+        if (q->unknown_flags[i]) continue;
+        npats[i] = 0;
+        for (Count k = 0; k < vs->n; k++) {
+            Bits p = 0;
+            for (int b = 0; b <= d && b < MAXCHVEC; b++)
+                if (cv[b].att == i && bitIsSet(vs->hashes[k],cv[b].bit))
+                    p = setBit(p,b);
+            Count j;
+            for (j = 0; j < npats[i] && pats[i][j] != p; j++) ;
+            if (j == npats[i]) pats[i][npats[i]++] = p;
+        }
+    }
+
+    Count max = 64, n = 0;
+    PageID *list = arenaAlloc(q->arena, max*sizeof(PageID));
+    for (;;) {
+        // candidates for this combination of patterns
+        q->known = 0;
+        for (int i = 0; i < na; i++) q->known |= pats[i][at[i]];
+        Bits cand = q->known & lowMask(d);
+        int half = 0;
+        PageID pid = candBucket(q,cand,0);
+        while (pid != NO_PAGE) {
+            if (n == max) {
+                list = arenaGrow(q->arena, list, max*sizeof(PageID),
+                                 2*max*sizeof(PageID));
+                max *= 2;
+            }
+            list[n++] = pid;
+            pid = nextCandidate(q, &cand, &half);
+        }
+        // next combination
+        int i;
+        for (i = 0; i < na && ++at[i] == npats[i]; i++) at[i] = 0;
+        if (i == na) break;
     }
-    Query new = malloc(sizeof(struct QueryRep));
-    assert(new != NULL);
+    qsort(list, n, sizeof(PageID), cmpPageID);
+    Count m = 0;
+    for (Count k = 0; k < n; k++)
+        if (m == 0 || list[k] != list[m-1]) list[m++] = list[k];
+    q->buckets = list;
+    q->nbuckets = m;
+}
+
+// set up a QueryRep object for a scan, given each attribute's value
+//   (NULL if unknown); if lists is set, values may be IN-lists
+// the query, and everything it needs, is allocated in arena a
+
+static Query makeQuery(Reln r, char **vals, Bool lists, Arena a)
+{
+    long long t = traceStart();
+    int attr = nattrs(r);
+    Query new = arenaAlloc(a, sizeof(struct QueryRep));
+    new->arena = a;
+    new->tuple = NULL;
+    new->pin = NULL;
     new->rel = r;
+    new->tstart = now();
     Bits unknown = 0;
     Bits known = 0;
     ChVecItem *cv = chvec(r);
-    int *unknown_flag = malloc(sizeof(int)*nattrs(r));
-    //multi-hash
-    Bits hashs[attr];
-    Bits hash;
-
-    new->vals = malloc(sizeof(char *)*nattrs(r));
-    tupleVals(q,new->vals);
-    char cmp_tmp[2] = "?\0";
+    int *unknown_flag = arenaAlloc(a, sizeof(int)*nattrs(r));
+    Bool inlist = FALSE;
+
+    // values of dictionary-encoded attributes are translated to ids,
+    // and of integer attributes to integers, so that matching compares
+    // integers; if none of an attribute's values can occur, no tuple
+    // can match
+    new->empty = FALSE;
     for(int i=0;i<attr;i++){
-        hash = 0;
-        if (strcmp(new->vals[i],cmp_tmp)!=0){
-            hash = hash_any((unsigned char *)new->vals[i],strlen(new->vals[i]));
-            hashs[i]=hash;
+        new->sets[i].n = 0;
+        if (vals[i]!=NULL){
+            makeValueSet(r,i,vals[i],lists,&new->sets[i],a);
             unknown_flag[i]=0;
+            if (new->sets[i].n == 0) new->empty = TRUE;
+            if (new->sets[i].n > 1) inlist = TRUE;
         }else{
             unknown_flag[i]=1;
         }
-        char buf[MAXBITS+1];
-        bitsString(hash,buf);
     }
     new->unknown_flags = unknown_flag;
 
-   
+    // a key value occurs in at most one tuple, so a scan for known
+    // key values can stop once it has found them all
+    new->limit = NO_LIMIT;
+    new->nfound = 0;
+    Count key = keyAttr(r);
+    if (key != NO_KEY && !unknown_flag[key])
+        new->limit = new->sets[key].n;
+
+    // in PAX pages, the first known attribute with a single value has
+    // its minipage searched for the value's field; the other attributes
+    // are only examined for tuples found that way
+    new->drive = -1;
+    for (int i = 0; i < attr && new->drive < 0; i++) {
+        ValueSet *vs = &new->sets[i];
+        if (unknown_flag[i] || vs->n != 1) continue;
+        new->drive = i;
+        if (attrEncoding(r,i) == ATT_DICT)
+            new->nlen = putVarint(vs->ids[0], new->needle);
+        else if (fieldWidth(attrEncoding(r,i)) > 0)
+            new->nlen = putIntField(attrEncoding(r,i), vs->ints[0],
+                                    new->needle);
+        else if ((relnFlags(r) & RELN_OUTOFLINE) &&
+                 outOfLine(vs->vals[0], vs->lens[0]))
+            new->nlen = heapRefPrefix(vs->hashes[0], vs->lens[0],
+                                      new->needle);
+        else {
+            strcpy(new->needle, vs->vals[0]);
+            new->nlen = vs->lens[0]+1;
+        }
+    }
+
     for(int i = 0;i<MAXCHVEC;i++){
         int att = cv[i].att;
         int bit = cv[i].bit;
         if(unknown_flag[att]==1){
             unknown = setBit(unknown,i);
-        }else{
-            if(bitIsSet(hashs[att],bit)){
+        }else if(new->sets[att].n > 0){
+            if(bitIsSet(new->sets[att].hashes[0],bit)){
                 known = setBit(known,i);
             }
         }
     }
-    char buf2[MAXBITS+1];
-    bitsString(known,buf2);
-    char buf3[MAXBITS+1];
-    bitsString(unknown,buf3);
     new->unknown = unknown;
     new->known = known;
-    int lower=depth(r);
-    Bits pid = getLower(known,lower);
-    if(pid < splitp(r)){
-        pid = getLower(known,lower+1);
-    }
-    char buf4[MAXBITS+1];
-    bitsString(pid,buf4);
 
-    new->curpage = pid;
+    // first candidate has all unknown bits zero
+    new->buckets = NULL;
+    new->nbuckets = 0;
+    new->cand = known & lowMask(depth(r));
+    new->half = 0;
+    if (inlist && !new->empty) {
+        listCandidates(new);
+        new->cand = 0;
+    }
+    new->curpage = (new->buckets != NULL) ? new->buckets[0]
+                                          : candBucket(new,new->cand,0);
     new->curtup = 1;
     new->curdata = 0;
-    new->is_ovflow = -1;
-    // Partial algorithm:
-    // form known bits from known attributes
-    // form unknown bits from '?' attributes
-    // compute PageID of first page
-    //   using known bits and first "unknown" value
+    new->is_ovflow = NO_PAGE;
+    new->page = NULL;
+
+    // start reading the first few candidate buckets in the background
+    new->pfcand = new->cand;
+    new->pfhalf = 0;
+    prefetchPages(dataFile(r), new->curpage, 1);
+    for (int i = 0; i < PREFETCH; i++) {
+        PageID pid = nextCandidate(new, &new->pfcand, &new->pfhalf);
+        if (pid == NO_PAGE) break;
+        prefetchPages(dataFile(r), pid, 1);
+    }
+    new->nbread = new->ndread = new->noread = new->ntread = 0;
+    new->analyze = FALSE;
+    new->tscan = 0;
+    new->tplan = now() - new->tstart;
+    traceEnd(OP_QUERY, t, NO_PAGE);
     return new;
 }
 
-// get next tuple during a scan
+// take a query string (e.g. "1234,?,abc,?" or "1|5|9,?,abc,?")
+// set up a QueryRep object for the scan
 
-Tuple getNextTuple(Query q)
+Query startQuery(Reln r, char *q)
 {
-    Page cur = getPage(dataFile(q->rel),q->curpage);
-    if(q->is_ovflow == -1){
-        Tuple result = getTupleInPage(q);
-        if (result){
-            free(cur);
-            return result;
+    int attr = nattrs(r);
+    int counter = 0;
+    for(int i = 0;i<strlen(q);i++){
+        if(q[i]==','){
+            counter++;
         }
     }
-    if (pageOvflow(cur)!=-1&&q->is_ovflow == NO_PAGE){
-        q->is_ovflow = pageOvflow(cur);
-        q->curtup = 1;
-        q->curdata = 0;
+    if (counter!= attr-1){
+        return NULL;
     }
-    free(cur);
-    while(q->is_ovflow != NO_PAGE){
-        Tuple result = getTupleInPage(q);
-        if (result){
+    Arena a = newArena();
+    char *vals[MAXATTRS];
+    tupleVals(q,vals,a);
+    char *given[MAXATTRS];
+    for (int i = 0; i < attr; i++)
+        given[i] = (strcmp(vals[i],"?") == 0) ? NULL : vals[i];
+    return makeQuery(r, given, TRUE, a);
+}
+
+// set up a scan for the tuple with the same key value as t
+// (the relation must have a key attribute)
+
+Query startKeyQuery(Reln r, Tuple t)
+{
+    int attr = nattrs(r);
+    Arena a = newArena();
+    char *vals[MAXATTRS];
+    tupleVals(t,vals,a);
+    char *given[MAXATTRS];
+    for (int i = 0; i < attr; i++)
+        given[i] = (i == keyAttr(r)) ? vals[i] : NULL;
+    return makeQuery(r, given, FALSE, a);
+}
+
+// stop the scan after at most n more matches
+
+void limitQuery(Query q, Count n)
+{
+    if (n < q->limit - q->nfound) q->limit = q->nfound + n;
+}
+
+// read the current page of the scan into the query's buffer
+// while its tuples are examined, the rest of the bucket's chain
+//   (adjacent pages, since overflow pages come in extents) is
+//   already being read in the background
+
+static void loadPage(Query q)
+{
+    if (q->is_ovflow == NO_PAGE) {
+        q->page = getPage(dataFile(q->rel),q->curpage);
+        q->nbread++; q->ndread++;
+    }
+    else {
+        q->page = getPage(ovflowFile(q->rel),q->is_ovflow);
+        q->noread++;
+    }
+    q->ntread += pageNTuples(q->page);
+    prefetchPages(ovflowFile(q->rel), pageOvflow(q->page), PREFETCH);
+    q->curtup = 1;
+    q->curdata = 0;
+    if (relnFlags(q->rel) & RELN_PAX) {
+        Count na = nattrs(q->rel), size;
+        for (int i = 0; i < na; i++) {
+            q->field[i] = pageMinipage(q->page, na, i, &size);
+            q->fidx[i] = 0;
+            if (i == q->drive) q->dend = q->field[i] + size;
+        }
+    }
+}
+
+// get next matching record during a scan (NULL if no more)
+// examine the current page; when it's exhausted, move along
+//   the bucket's overflow chain, then on to the next candidate
+//   bucket, keeping the prefetch frontier PREFETCH buckets ahead
+// the record is only valid until the next call
+// the scan ends early once it has found limit matches
+
+static char *scanForRecord(Query q);
+static void dropPage(Query q);
+
+static char *getNextRecord(Query q)
+{
+    long long t0 = traceStart();
+    char *rec;
+    if (!q->analyze)
+        rec = scanForRecord(q);
+    else {
+        double t = now();
+        rec = scanForRecord(q);
+        q->tscan += now() - t;
+    }
+    traceEnd(OP_NEXT, t0, q->curpage);
+    return rec;
+}
+
+static char *scanForRecord(Query q)
+{
+    if (q->empty || q->nfound >= q->limit) return NULL;
+    for (;;) {
+        if (q->page == NULL) loadPage(q);
+        char *result = getRecordInPage(q);
+        if (result) {
+            q->nfound++;
             return result;
         }
-        cur = getPage(ovflowFile(q->rel),q->is_ovflow);
-        if(pageOvflow(cur)!=-1){
-            q->is_ovflow = pageOvflow(cur);
-            free(cur);
-            q->curtup = 1;
-            q->curdata = 0;
+
+        PageID ov = pageOvflow(q->page);
+        dropPage(q);
+        if (ov != NO_PAGE) {
+            q->is_ovflow = ov;
             continue;
-        } else {
-            free(cur);
-            break;
         }
+        PageID next = nextCandidate(q, &q->cand, &q->half);
+        if (next == NO_PAGE) return NULL;
+        q->curpage = next;
+        q->is_ovflow = NO_PAGE;
+        prefetchPages(dataFile(q->rel),
+                      nextCandidate(q, &q->pfcand, &q->pfhalf), 1);
     }
-    int cur_pid = q->curpage;
-    if (cur_pid == npages(q->rel) - 1) {
-        return NULL;
+}
+
+// let go of the scan's current page: it's freed, unless views
+//   pinned on it still need it
+
+static void dropPage(Query q)
+{
+    if (q->pin == NULL)
+        free(q->page);
+    else if (--q->pin->refs == 0) {
+        free(q->page);
+        free(q->pin);
     }
-    int cur_pid_copy = cur_pid;
-    int lower = depth(q->rel);
-    Bits pid = getLower(q->known, lower);
+    q->page = NULL;
+    q->pin = NULL;
+}
+
+// get a view of the next matching record during a scan
+// the view points at the record in place, in the scan's page buffer,
+//   so nothing is copied; it's only valid until the next call, unless
+//   it's pinned
+// returns FALSE if there are no more matches
+
+Bool getNextView(Query q, TupleView *v)
+{
+    char *rec = getNextRecord(q);
+    if (rec == NULL) return FALSE;
+    v->rel = q->rel;
+    v->rec = rec;
+    v->len = recordLength(q->rel, rec);
+    v->pin = NULL;
+    return TRUE;
+}
+
+// keep a view valid after the scan moves on, until releaseView
+// pinning holds the whole page, so a pinned view costs no copy,
+//   except in a PAX relation, where the record itself is copied
 
-    if (pid < splitp(q->rel)) {
-        ++lower;
+void pinView(Query q, TupleView *v)
+{
+    if (v->pin != NULL) return;
+    if (relnFlags(q->rel) & RELN_PAX) {
+        struct ViewPin *p = malloc(sizeof(struct ViewPin) + v->len);
+        assert(p != NULL);
+        p->page = NULL;
+        p->refs = 1;
+        v->rec = memcpy((char *)(p+1), v->rec, v->len);
+        v->pin = p;
+        return;
+    }
+    if (q->pin == NULL) {
+        q->pin = malloc(sizeof(struct ViewPin));
+        assert(q->pin != NULL);
+        q->pin->page = q->page;
+        q->pin->refs = 1;
     }
+    q->pin->refs++;
+    v->pin = q->pin;
+}
+
+// release a pinned view (does nothing if it isn't pinned)
 
-    int filp_unknown = ~q->unknown;
-    int tmp = cur_pid & q->unknown;
-    tmp = tmp|filp_unknown;
-    tmp++;
-    tmp = tmp&q->unknown;
-    cur_pid = cur_pid & filp_unknown;
-    cur_pid = cur_pid |tmp;
+void releaseView(TupleView *v)
+{
+    struct ViewPin *p = v->pin;
+    if (p == NULL) return;
+    if (--p->refs == 0) {
+        free(p->page);
+        free(p);
+    }
+    v->pin = NULL;
+    v->rec = NULL;
+}
 
+// attribute i's field in a view, as stored (e.g. a dictionary id or
+//   a binary integer in an encoded relation); sets *f to point at it,
+//   and returns its length
 
-    if (cur_pid_copy >= cur_pid||cur_pid > npages(q->rel)-1) {
-        return NULL;
+Count viewField(TupleView *v, int i, char **f)
+{
+    char *fields[MAXATTRS];
+    Count lens[MAXATTRS];
+    recordFields(v->rel, v->rec, fields, lens);
+    *f = fields[i];
+    return lens[i];
+}
+
+// put attribute i's printable value from a view in buf
+// returns the value's length
+
+Count viewValue(TupleView *v, int i, char *buf)
+{
+    char *f;
+    Count len = viewField(v, i, &f);
+    return fieldValue(v->rel, i, f, len, buf);
+}
+
+// materialise a view as a tuple in buf (at least MAXLINE bytes)
+
+void viewTuple(TupleView *v, Tuple buf)
+{
+    recordToTuple(v->rel, v->rec, buf);
+}
+
+// get next tuple during a scan
+// returns the tuple, or NULL if no more; it's held by the query, and
+//   is only valid until the next call (or closeQuery)
+
+Tuple getNextTuple(Query q)
+{
+    TupleView v;
+    if (!getNextView(q, &v)) return NULL;
+    if (q->tuple == NULL) q->tuple = arenaAlloc(q->arena, MAXLINE);
+    viewTuple(&v, q->tuple);
+    return q->tuple;
+}
+
+// does the field of len bytes at f, for attribute i, hold value k
+//   of the attribute's value set?
+
+static Bool fieldIs(Query q, int i, Count k, char *f, Count len)
+{
+    ValueSet *vs = &q->sets[i];
+    Byte enc = attrEncoding(q->rel,i);
+    if (enc == ATT_DICT) {
+        Count id;
+        getVarint(f, &id);
+        relnCount(q->rel, CNT_COMPARE, sizeof(Count));
+        return (id == vs->ids[k]);
     }
-    q->curpage = cur_pid;
-    q->curdata = 0;
-    q->curtup = 1;
-    q->is_ovflow = NO_PAGE;
-
-    return getNextTuple(q);
-    // Partial algorithm:
-    // if (more tuples in current page)
-    //    get next matching tuple from current page
-    // else if (current page has overflow)
-    //    move to overflow page
-    //    grab first matching tuple from page
-    // else
-    //    move to "next" bucket
-    //    grab first matching tuple from data page
-    // endif
-    // if (current page has no matching tuples)
-    //    go to next page (try again)
-    // endif
-    //return NULL;
-}
-
-Tuple getTupleInPage(Query q){
-    Page cur;
-    if (q->is_ovflow == -1){
-        cur = getPage(dataFile(q->rel),q->curpage);
-    }else{
-        cur = getPage(ovflowFile(q->rel),q->is_ovflow);
-    }
-    int last_tuple = pageNTuples(cur);
-    if(q->curtup <= last_tuple) {
-        int attr = nattrs(q->rel);
-        char **vals = malloc(sizeof(char *) * attr);
-        int match;
-        Tuple result;
-        while (q->curtup <= last_tuple) {
-            match = 1;
-            result = malloc(sizeof(char *) * (strlen(&pageData(cur)[q->curdata])));
-            strcpy(result, &pageData(cur)[q->curdata]);
-            tupleVals(result, vals);
-            for (int i = 0; i < attr; i++) {
-                if (!q->unknown_flags[i]) {
-                    if (strcmp(q->vals[i], vals[i]) != 0) {
-                        match = 0;
-                        break;
-                    }
+    if (fieldWidth(enc) > 0) {
+        relnCount(q->rel, CNT_COMPARE, fieldWidth(enc));
+        return (getIntField(enc, f) == vs->ints[k]);
+    }
+    if (isHeapRef(q->rel, f, len)) {
+        // only fetch the value if its hash and length match
+        Bits hash; Count vlen;
+        heapRefInfo(f, &hash, &vlen);
+        if (hash != vs->hashes[k] || vlen != vs->lens[k]) return FALSE;
+        char val[MAXLINE];
+        heapGet(relnHeap(q->rel), f, val);
+        relnCount(q->rel, CNT_COMPARE, vlen);
+        return memcmp(val, vs->vals[k], vlen) == 0;
+    }
+    if (len != vs->lens[k]) return FALSE;
+    relnCount(q->rel, CNT_COMPARE, len);
+    return memcmp(f, vs->vals[k], len) == 0;
+}
+
+// does the field of len bytes at f, for attribute i, match the query?
+// an IN-list's value set is probed with the field's hash
+
+static Bool fieldMatches(Query q, int i, char *f, Count len)
+{
+    if (q->unknown_flags[i]) return TRUE;
+    ValueSet *vs = &q->sets[i];
+    if (vs->n == 1) return fieldIs(q, i, 0, f, len);
+    Bits h = fieldHash(q->rel, i, f, len);
+    Count mask = vs->nslots-1;
+    for (Count s = h & mask; vs->slots[s] != NO_ID; s = (s+1) & mask) {
+        Count k = vs->slots[s];
+        if (vs->hashes[k] == h && fieldIs(q, i, k, f, len)) return TRUE;
+    }
+    return FALSE;
+}
+
+// check the record at rec against the query's known values
+// returns pointer just past the record; sets *match
+
+static char *matchRecord(Query q, char *rec, Bool *match)
+{
+    char *fields[MAXATTRS];
+    Count lens[MAXATTRS];
+    Count len = recordFields(q->rel, rec, fields, lens);
+    *match = TRUE;
+    for (int i = 0; i < nattrs(q->rel) && *match; i++)
+        *match = fieldMatches(q, i, fields[i], lens[i]);
+    return rec + len;
+}
+
+// PAX: move minipage i's cursor on to the field of tuple k
+// fixed-width fields are located directly
+
+static void seekField(Query q, int i, Count k)
+{
+    Count w = fieldWidth(attrEncoding(q->rel,i));
+    if (w > 0 && q->fidx[i] < k) {
+        q->field[i] += (k - q->fidx[i]) * w;
+        q->fidx[i] = k;
+    }
+    while (q->fidx[i] < k) {
+        q->field[i] = skipField(q->rel, q->field[i], i);
+        q->fidx[i]++;
+    }
+}
+
+// PAX: does byte c end a field of the drive attribute?
+
+static Bool endsField(Query q, char c)
+{
+    if (attrEncoding(q->rel,q->drive) == ATT_DICT) return (c & 0x80) == 0;
+    return c == '\0';
+}
+
+// PAX: index of the next tuple, from k on, whose drive attribute
+//   matches, found by searching the drive minipage for the needle;
+//   returns pageNTuples if there is none
+// a hit must start at a field boundary; the tuple index is the number
+//   of field ends before it, counted in a loop that vectorises well
+// an integer drive minipage is an array, and is scanned as one
+
+static Count findDrive(Query q, Count k)
+{
+    Count n = pageNTuples(q->page);
+    seekField(q, q->drive, k);
+    Byte enc = attrEncoding(q->rel,q->drive);
+    Count w = fieldWidth(enc);
+    if (w > 0) {
+        char *f = q->field[q->drive];
+        Count k0 = k;
+        for (; k < n; k++, f += w)
+            if (getIntField(enc, f) == q->sets[q->drive].ints[0]) break;
+        relnCount(q->rel, CNT_COMPARE, (k - k0 + (k < n)) * w);
+        q->field[q->drive] = f;
+        q->fidx[q->drive] = k;
+        return k;
+    }
+    char *from = q->field[q->drive];
+    char *c = from;
+    for (;;) {
+        char *at = memmem(c, q->dend - c, q->needle, q->nlen);
+        // memmem looks at (roughly) every byte it passes
+        relnCount(q->rel, CNT_COMPARE,
+                  (at == NULL) ? q->dend - c : at - c + q->nlen);
+        c = at;
+        if (c == NULL) return n;
+        if (c == from || endsField(q, c[-1])) break;
+        c++;
+    }
+    Count ends = 0;
+    if (attrEncoding(q->rel,q->drive) == ATT_DICT)
+        for (char *p = from; p < c; p++) ends += ((*p & 0x80) == 0);
+    else
+        for (char *p = from; p < c; p++) ends += (*p == '\0');
+    q->field[q->drive] = c;
+    q->fidx[q->drive] += ends;
+    return q->fidx[q->drive];
+}
+
+// PAX: find the next matching record in the current page buffer
+// only the drive attribute's minipage is scanned in full; a tuple
+//   is assembled from the other minipages only if its drive value
+//   matches (or if there is no drive attribute)
+// a long drive value is found by its reference prefix, so the drive
+//   field is checked along with the others
+
+static char *getRecordInPaxPage(Query q)
+{
+    Reln r = q->rel;
+    Count n = pageNTuples(q->page);
+    while (q->curtup <= n) {
+        Count k = q->curtup - 1;
+        if (q->drive >= 0) k = findDrive(q, k);
+        if (k >= n) { q->curtup = n+1; break; }
+        q->curtup = k+2;
+        char *c = q->rec;
+        Bool match = TRUE;
+        for (int i = 0; i < nattrs(r) && match; i++) {
+            seekField(q, i, k);
+            char *next = skipField(r, q->field[i], i);
+            Count len = next - q->field[i];
+            if (attrEncoding(r,i) == ATT_TEXT) len--;
+            match = fieldMatches(q, i, q->field[i], len);
+            memcpy(c, q->field[i], next - q->field[i]);
+            c += next - q->field[i];
+        }
+        if (match) return q->rec;
+    }
+    return NULL;
+}
+
+// find the next matching record in the current page buffer
+// returns a pointer to it, or NULL if none left in page
+
+static char *getRecordInPage(Query q){
+    if (relnFlags(q->rel) & RELN_PAX) return getRecordInPaxPage(q);
+    Page cur = q->page;
+    while (q->curtup <= pageNTuples(cur)) {
+        char *rec = &pageData(cur)[q->curdata];
+        Bool match;
+        char *next = matchRecord(q, rec, &match);
+        q->curdata += next - rec;
+        q->curtup++;
+        if (match) return rec;
+    }
+    return NULL;
+}
+
+// write the matching tuples to out, one per line, with just the
+//   attributes in atts, in that order (all attributes if natts is 0)
+// the values are taken straight from the records, and collected in a
+//   large buffer, which is written out whenever it fills
+// returns the number of tuples written
+
+#define OUTBUF (1<<16)
+
+Count writeQuery(Query q, int *atts, int natts, FILE *out)
+{
+    Reln r = q->rel;
+    char *buf = arenaAlloc(q->arena, OUTBUF), *c = buf;
+    Count n = 0;
+    char *rec;
+    while ((rec = getNextRecord(q)) != NULL) {
+        if (c - buf > OUTBUF - MAXLINE) {
+            fwrite(buf, 1, c - buf, out);
+            c = buf;
+        }
+        if (natts == 0) {
+            recordToTuple(r, rec, c);
+            c += strlen(c);
+        }
+        else {
+            char *fields[MAXATTRS];
+            Count lens[MAXATTRS];
+            recordFields(r, rec, fields, lens);
+            for (int j = 0; j < natts; j++) {
+                // a projection may repeat attributes, so the line
+                // can be longer than a tuple
+                if (c - buf > OUTBUF - MAXLINE) {
+                    fwrite(buf, 1, c - buf, out);
+                    c = buf;
                 }
+                int i = atts[j];
+                if (j > 0) *c++ = ',';
+                c += fieldValue(r, i, fields[i], lens[i], c);
             }
-            freeVals(vals,attr);
-            q->curdata += (strlen(&pageData(cur)[q->curdata]) + 1);
-            q->curtup++;
-            if (match) {
-                break;
+        }
+        *c++ = '\n';
+        n++;
+    }
+    fwrite(buf, 1, c - buf, out);
+    return n;
+}
+
+// Aggregates over the tuples that match a query
+// Group-by aggregates use a hash table of groups, keyed on the
+//   attribute's field as stored (e.g. a dictionary id), so values
+//   are only made printable once per group
+
+typedef struct {
+    Bits   hash;
+    Count  len;
+    char  *key;    // NULL if slot is empty
+    Count  count;
+} Group;
+
+typedef struct {
+    Count  nslots;  // a power of 2
+    Count  n;
+    Group *slots;
+    Arena  arena;   // the query's; holds slots and keys
+} Groups;
+
+static void groupsInit(Groups *g, Count nslots, Arena a)
+{
+    g->nslots = nslots;
+    g->n = 0;
+    g->slots = arenaAlloc(a, nslots*sizeof(Group));
+    memset(g->slots, 0, nslots*sizeof(Group));
+    g->arena = a;
+}
+
+static Group *findGroup(Groups *g, Bits hash, char *key, Count len)
+{
+    Count i = hash & (g->nslots-1);
+    while (g->slots[i].key != NULL) {
+        Group *gr = &g->slots[i];
+        if (gr->hash == hash && gr->len == len &&
+            memcmp(gr->key, key, len) == 0) break;
+        i = (i+1) & (g->nslots-1);
+    }
+    return &g->slots[i];
+}
+
+// count one more tuple in the group for key
+
+static void addToGroup(Groups *g, char *key, Count len)
+{
+    Bits hash = hash_any((unsigned char *)key, len);
+    Group *gr = findGroup(g, hash, key, len);
+    if (gr->key == NULL) {
+        gr->hash = hash; gr->len = len; gr->count = 0;
+        gr->key = arenaAlloc(g->arena, len);
+        memcpy(gr->key, key, len);
+        // keep table at most half full
+        if (++g->n > g->nslots/2) {
+            Groups bigger;
+            groupsInit(&bigger, 2*g->nslots, g->arena);
+            for (Count i = 0; i < g->nslots; i++) {
+                Group *old = &g->slots[i];
+                if (old->key == NULL) continue;
+                *findGroup(&bigger, old->hash, old->key, old->len) = *old;
+                bigger.n++;
             }
-            free(result);
+            *g = bigger;
+            gr = findGroup(g, hash, key, len);
         }
-        free(vals);
-        if (match == 1) {
-            //tupleHash(q->rel,result);
-            free(cur);
-            return result;
+    }
+    gr->count++;
+}
 
+// group the matching tuples on attribute att
+// a long value's key is the value itself, as its references differ
+
+static void groupQuery(Query q, int att, Groups *g)
+{
+    Reln r = q->rel;
+    char *rec;
+    groupsInit(g, 1024, q->arena);
+    while ((rec = getNextRecord(q)) != NULL) {
+        char *fields[MAXATTRS];
+        Count lens[MAXATTRS];
+        recordFields(r, rec, fields, lens);
+        char *f = fields[att];
+        Count len = lens[att];
+        char val[MAXLINE];
+        if (isHeapRef(r, f, len)) {
+            len = fieldValue(r, att, f, len, val);
+            f = val;
         }
+        addToGroup(g, f, len);
+        relnCount(r, CNT_HASH, 1);
+    }
+}
+
+// are all of the query's values unknown?
+
+static Bool allUnknown(Query q)
+{
+    for (int i = 0; i < nattrs(q->rel); i++)
+        if (!q->unknown_flags[i]) return FALSE;
+    return TRUE;
+}
+
+// number of tuples matching the query
+// if no values are known, all tuples match, and they're counted from
+//   the page headers, without looking at the tuples themselves
+
+Count countQuery(Query q)
+{
+    Reln r = q->rel;
+    Count n = 0;
+    if (q->empty) return 0;
+    if (!allUnknown(q)) {
+        while (getNextRecord(q) != NULL) n++;
+        return n;
+    }
+    double t = now();
+    prefetchPages(dataFile(r), 0, npages(r));
+    for (PageID pid = 0; pid < npages(r) && n < q->limit; pid++) {
+        Page p = getPage(dataFile(r), pid);
+        PageID ov = pageOvflow(p);
+        prefetchPages(ovflowFile(r), ov, PREFETCH);
+        n += pageNTuples(p);
+        q->nbread++; q->ndread++;
+        free(p);
+        while (ov != NO_PAGE) {
+            p = getPage(ovflowFile(r), ov);
+            n += pageNTuples(p);
+            q->noread++;
+            ov = pageOvflow(p);
+            free(p);
+        }
+    }
+    q->ntread = n;
+    q->nfound = (n < q->limit) ? n : q->limit;
+    q->tscan += now() - t;
+    return q->nfound;
+}
+
+// number of distinct values of attribute att in the matching tuples
+
+Count countDistinct(Query q, int att)
+{
+    Groups g;
+    groupQuery(q, att, &g);
+    Count n = g.n;
+    return n;
+}
+
+// write "value,count" for each value of attribute att in the
+//   matching tuples, in no particular order
+// returns the number of groups
+
+Count groupCount(Query q, int att, FILE *out)
+{
+    Reln r = q->rel;
+    Groups g;
+    groupQuery(q, att, &g);
+    char val[MAXLINE];
+    for (Count i = 0; i < g.nslots; i++) {
+        Group *gr = &g.slots[i];
+        if (gr->key == NULL) continue;
+        if (attrEncoding(r,att) == ATT_TEXT) {
+            // the key is the value
+            fwrite(gr->key, 1, gr->len, out);
+        }
+        else {
+            fieldValue(r, att, gr->key, gr->len, val);
+            fputs(val, out);
+        }
+        fprintf(out, ",%d\n", gr->count);
+    }
+    Count n = g.n;
+    return n;
+}
+
+// print the query's plan: how its hash is formed, and which
+//   buckets it will scan (before the scan starts)
+
+void explainQuery(Query q, FILE *out)
+{
+    Reln r = q->rel;
+    Count d = depth(r), sp = splitp(r), na = nattrs(r);
+    char buf[MAXBITS+5];
+    fprintf(out, "File: depth %d, split pointer %d, %d buckets\n",
+            d, sp, npages(r));
+    fprintf(out, "Values:");
+    for (int i = 0; i < na; i++) {
+        if (q->unknown_flags[i])
+            fprintf(out, " %d:?", i);
+        else
+            fprintf(out, " %d:%d", i, q->sets[i].n);
+    }
+    fputc('\n', out);
+    if (q->buckets == NULL) {
+        bitsString(q->known & lowMask(d+1), buf);
+        fprintf(out, "Known bits:   %s\n", buf);
+    }
+    else
+        fprintf(out, "Known bits:   from IN-lists (union of buckets)\n");
+    bitsString(q->unknown & lowMask(d+1), buf);
+    fprintf(out, "Unknown bits: %s\n", buf);
+    if ((relnFlags(r) & RELN_PAX) && q->drive >= 0)
+        fprintf(out, "PAX drive attribute: %d\n", q->drive);
+    if (q->limit != NO_LIMIT) fprintf(out, "Limit: %d\n", q->limit);
+    if (q->empty) {
+        fprintf(out, "Candidate buckets: 0 (a value can't occur)\n");
+        return;
+    }
+
+    // enumerate candidates from the start, as the scan will
+    Bits cand = (q->buckets != NULL) ? 0 : q->known & lowMask(d);
+    int half = 0;
+    PageID pid = (q->buckets != NULL) ? q->buckets[0]
+                                      : candBucket(q,cand,0);
+    Count n = 0;
+    fprintf(out, "Candidates:");
+    while (pid != NO_PAGE) {
+        if (n < 64) fprintf(out, " %d", pid);
+        else if (n == 64) fprintf(out, " ...");
+        n++;
+        pid = nextCandidate(q, &cand, &half);
+    }
+    fputc('\n', out);
+    fprintf(out, "Candidate buckets: %d of %d\n", n, npages(r));
+    // estimates from bucket averages; the overflow file can include
+    // unused pages of extents, so the chain length is an upper bound
+    double tups = (double)ntuples(r) / npages(r);
+    double chain = (double)(npages(r) + filePages(ovflowFile(r))) / npages(r);
+    fprintf(out, "Estimated tuples examined: %.0f  (%.1f per bucket)\n",
+            n * tups, tups);
+    fprintf(out, "Estimated pages: at most %.0f  (%.2f per bucket)\n",
+            n * chain, chain);
+    // matches from the sketches of each attribute's distinct values,
+    //   assuming values are equally common and attributes independent,
+    //   and the candidate buckets they'd fall in if spread at random
+    Sketch sk = relnSketch(r);
+    double sel = 1.0;
+    for (int i = 0; i < na; i++) {
+        if (q->unknown_flags[i]) continue;
+        double ndv = sketchDistinct(sk, i);
+        if (q->sets[i].n < ndv) sel *= q->sets[i].n / ndv;
+    }
+    double matches = sel * ntuples(r);
+    if (q->limit != NO_LIMIT && matches > q->limit) matches = q->limit;
+    double hit = (n > 0) ? n * (1.0 - pow(1.0 - 1.0/n, matches)) : 0.0;
+    fprintf(out, "Estimated matches: %.0f  (in %.0f of the candidate buckets)\n",
+            matches, hit);
+}
+
+// time the scan as well as counting what it reads
+// (call before getting any tuples)
+
+void analyzeQuery(Query q)
+{
+    q->analyze = TRUE;
+}
+
+// print what the scan has read and found, and (if analyzing) how
+//   long each phase took: setting up, scanning, and the rest (output)
+
+void queryStats(Query q, FILE *out)
+{
+    fprintf(out, "Buckets scanned: %d\n", q->nbread);
+    fprintf(out, "Pages read: %d data, %d overflow\n", q->ndread, q->noread);
+    fprintf(out, "Tuples examined: %d\n", q->ntread);
+    fprintf(out, "Tuples matched: %d\n", q->nfound);
+    if (q->nbread > 0)
+        fprintf(out, "Average chain: %.2f pages\n",
+                (double)(q->ndread + q->noread) / q->nbread);
+    if (q->analyze) {
+        double total = now() - q->tstart;
+        fprintf(out, "Time: %.3fms plan, %.3fms scan, %.3fms output\n",
+                1000*q->tplan, 1000*q->tscan,
+                1000*(total - q->tplan - q->tscan));
     }
-    free(cur);
-    return NULL;
 }
 
 // clean up a QueryRep object and associated data
@@ -240,9 +1145,7 @@ void closeQuery(Query q)
 {
 
 
-    freeVals(q->vals,nattrs(q->rel));
     //free(q->rel);
-    free(q->vals);
-    free(q->unknown_flags);
-    free(q);
+    if (q->page != NULL) dropPage(q);
+    freeArena(q->arena);
 }
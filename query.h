@@ -10,8 +10,33 @@ typedef struct QueryRep *Query;
 #include "reln.h"
 #include "tuple.h"
 
+#define NO_LIMIT 0xffffffff
+
+// a matching record, seen in place in the scan's page buffer
+typedef struct {
+    Reln    rel;
+    char   *rec;   // the record, as stored
+    Count   len;   // its length in bytes
+    struct ViewPin *pin; // page held for the view (NULL if not pinned)
+} TupleView;
+
 Query startQuery(Reln, char *);
+Query startKeyQuery(Reln, Tuple);
+void limitQuery(Query, Count);
 Tuple getNextTuple(Query);
+Bool getNextView(Query, TupleView *);
+void pinView(Query, TupleView *);
+void releaseView(TupleView *);
+Count viewField(TupleView *, int, char **);
+Count viewValue(TupleView *, int, char *);
+void viewTuple(TupleView *, Tuple);
+Count writeQuery(Query, int *, int, FILE *);
+Count countQuery(Query);
+Count countDistinct(Query, int);
+Count groupCount(Query, int, FILE *);
+void explainQuery(Query, FILE *);
+void analyzeQuery(Query);
+void queryStats(Query, FILE *);
 void closeQuery(Query);
 
 #endif
@@ -8,7 +8,12 @@
 #include "chvec.h"
 #include "bits.h"
 #include "hash.h"
+#include "dict.h"
+#include "heap.h"
+#include "summary.h"
+#include "trace.h"
 #include <math.h>
+#include <stdlib.h>
 
 #define HEADERSIZE (3*sizeof(Count)+sizeof(Offset))
 
@@ -19,33 +24,148 @@ struct RelnRep {
     Count  npages; // number of main data pages
     Count  ntups;  // total number of tuples
     ChVec  cv;     // choice vector
+    Byte   enc[MAXATTRS]; // how each attribute is stored (ATT_*)
+    Count  flags;  // relation options (RELN_*)
+    Count  version; // record format (see tuple.c)
+    Count  debt;   // splits due but not yet done (RELN_DEFERSPLIT)
+    Count  ahead;  // splits done before they were due (expandRelation)
+    Count  key;    // unique key attribute (NO_KEY if none)
+    PageID freelist; // first free overflow page (NO_PAGE if none)
+    Count  counts[NCOUNTS]; // work done while open (CNT_*)
+    char   name[MAXFILENAME]; // relation name, for counts
     char   mode;   // open for read/write
     FILE  *info;   // handle on info file
-    FILE  *data;   // handle on data file
-    FILE  *ovflow; // handle on ovflow file
+    File   data;   // handle on data file
+    File   ovflow; // handle on ovflow file
+    Dict   dict;   // value dictionary (NULL if no ATT_DICT attrs)
+    Heap   heap;   // value heap (NULL unless RELN_OUTOFLINE)
+    Summary sum;   // summary of each bucket (NULL if not loaded)
+    Sketch sketch; // distinct values of each attribute (NULL if not loaded)
+    Arena  arena;  // scratch space for the tuple being inserted or moved
 };
 
-// create a new relation (three files)
+// does the relation have any dictionary-encoded attributes?
 
-Status newRelation(char *name, Count nattrs, Count npages, Count d, char *cv)
+static Bool hasDict(Reln r)
 {
+    for (int i = 0; i < r->nattrs; i++)
+        if (r->enc[i] == ATT_DICT) return TRUE;
+    return FALSE;
+}
+
+// mode for opening data/ovflow files of a relation
+// adds 'z' to an openFile mode if the relation is compressed
+
+static char *fileMode(Reln r, char *mode, char *buf)
+{
+    strcpy(buf, mode);
+    if (r->flags & RELN_COMPRESSED) strcat(buf, "z");
+    return buf;
+}
+
+// free bytes in an empty page
+
+static Count emptyPageFree(void)
+{
+    Page p = newPage();
+    Count n = pageFreeSpace(p);
+    free(p);
+    return n;
+}
+
+// sketch the values of each attribute of the tuples in a page
+
+static void sketchPage(Reln r, Sketch sk, Page p)
+{
+    RecScan s;
+    char *rec, *fields[MAXATTRS];
+    Count len, lens[MAXATTRS];
+    startRecScan(r, p, &s);
+    while ((rec = nextRecord(r, &s, &len)) != NULL) {
+        recordFields(r, rec, fields, lens);
+        for (int i = 0; i < r->nattrs; i++)
+            sketchAdd(sk, i, fieldHash(r, i, fields[i], lens[i]));
+    }
+}
+
+// summarise each bucket (in sum) and/or sketch each attribute (in sk)
+//   from the relation's pages, for a relation without up-to-date
+//   summary or sketch files; either may be NULL
+
+static void scanRelation(Reln r, Summary sum, Sketch sk)
+{
+    for (PageID pid = 0; pid < r->npages; pid++) {
+        BucketSum *b = (sum != NULL) ? bucketSum(sum, pid) : NULL;
+        Page p = getPage(r->data, pid);
+        for (;;) {
+            if (b != NULL) {
+                b->ntups += pageNTuples(p);
+                b->npages++;
+                b->free += pageFreeSpace(p);
+            }
+            if (sk != NULL) sketchPage(r, sk, p);
+            PageID ov = pageOvflow(p);
+            free(p);
+            if (ov == NO_PAGE) break;
+            p = getPage(r->ovflow, ov);
+        }
+    }
+}
+
+// create a new relation (three files, plus R.dict and R.heap if needed)
+// enc gives the storage for each attribute (NULL => all ATT_TEXT)
+// flags gives relation options (RELN_*)
+// key is an attribute whose values are unique (NO_KEY if none)
+
+Status newRelation(char *name, Count nattrs, Count npages, Count d, char *cv,
+                   Byte *enc, Count flags, Count key)
+{
+    char fmode[8];
     char fname[MAXFILENAME];
     Reln r = malloc(sizeof(struct RelnRep));
+    assert(r != NULL);
     r->nattrs = nattrs; r->depth = d; r->sp = 0;
     r->npages = npages; r->ntups = 0; r->mode = 'w';
-    assert(r != NULL);
+    memset(r->counts, 0, sizeof(r->counts));
+    snprintf(r->name, MAXFILENAME, "%s", name);
+    memset(r->enc, ATT_TEXT, MAXATTRS);
+    if (enc != NULL) memcpy(r->enc, enc, nattrs);
+    r->flags = flags;
+    // PAX minipages hold self-delimiting (version 1) fields
+    r->version = (flags & RELN_PAX) ? 1 : RECVERSION;
+    r->debt = 0; r->ahead = 0;
+    r->key = key;
+    r->freelist = NO_PAGE;
+    r->arena = newArena();
     if (parseChVec(r, cv, r->cv) != OK) return ~OK;
+    r->dict = NULL;
+    if (hasDict(r)) {
+        r->dict = openDict(name,"w",nattrs);
+        assert(r->dict != NULL);
+    }
+    r->heap = NULL;
+    if (r->flags & RELN_OUTOFLINE) {
+        r->heap = openHeap(name,"w");
+        assert(r->heap != NULL);
+    }
     sprintf(fname,"%s.info",name);
     r->info = fopen(fname,"w");
     assert(r->info != NULL);
     sprintf(fname,"%s.data",name);
-    r->data = fopen(fname,"w");
+    r->data = openFile(fname,fileMode(r,"w",fmode));
     assert(r->data != NULL);
     sprintf(fname,"%s.ovflow",name);
-    r->ovflow = fopen(fname,"w");
+    r->ovflow = openFile(fname,fileMode(r,"w",fmode));
     assert(r->ovflow != NULL);
     int i;
-    for (i = 0; i < npages; i++) addPage(r->data);
+    r->sum = newSummary();
+    r->sketch = newSketch(nattrs);
+    for (i = 0; i < npages; i++) {
+        addPage(r->data);
+        BucketSum *b = bucketSum(r->sum, i);
+        b->npages = 1;
+        b->free = emptyPageFree();
+    }
     closeRelation(r);
     return 0;
 }
@@ -67,6 +187,8 @@ Bool existsRelation(char *name)
 
 // set up a relation descriptor from relation name
 // open files, reads information from rel.info
+// mode is "r" or "r+", with an optional 'd' (e.g. "rd") to access
+//   data and overflow pages with O_DIRECT
 
 Reln openRelation(char *name, char *mode)
 {
@@ -74,29 +196,79 @@ Reln openRelation(char *name, char *mode)
     r = malloc(sizeof(struct RelnRep));
     assert(r != NULL);
     char fname[MAXFILENAME];
+    char imode[3] = "r";
+    char fmode[8];
+    if (strchr(mode,'+') != NULL) strcpy(imode,"r+");
     sprintf(fname,"%s.info",name);
-    r->info = fopen(fname,mode);
+    r->info = fopen(fname,imode);
     assert(r->info != NULL);
-    sprintf(fname,"%s.data",name);
-    r->data = fopen(fname,mode);
-    assert(r->data != NULL);
-    sprintf(fname,"%s.ovflow",name);
-    r->ovflow = fopen(fname,mode);
-    assert(r->ovflow != NULL);
     // Naughty: assumes Count and Offset are the same size
     int n = fread(r, sizeof(Count), 5, r->info);
     assert(n == 5);
     n = fread(r->cv, sizeof(ChVecItem), MAXCHVEC, r->info);
     assert(n == MAXCHVEC);
-    r->mode = (mode[0] == 'w' || mode[1] =='+') ? 'w' : 'r';
+    // attribute storage and options; absent in older relations
+    n = fread(r->enc, 1, MAXATTRS, r->info);
+    if (n != MAXATTRS) memset(r->enc, ATT_TEXT, MAXATTRS);
+    n = fread(&r->flags, sizeof(Count), 1, r->info);
+    if (n != 1) r->flags = 0;
+    n = fread(&r->version, sizeof(Count), 1, r->info);
+    if (n != 1) r->version = 1;
+    n = fread(&r->debt, sizeof(Count), 1, r->info);
+    if (n != 1) r->debt = 0;
+    n = fread(&r->ahead, sizeof(Count), 1, r->info);
+    if (n != 1) r->ahead = 0;
+    n = fread(&r->key, sizeof(Count), 1, r->info);
+    if (n != 1) r->key = NO_KEY;
+    n = fread(&r->freelist, sizeof(PageID), 1, r->info);
+    if (n != 1) r->freelist = NO_PAGE;
+    sprintf(fname,"%s.data",name);
+    r->data = openFile(fname,fileMode(r,mode,fmode));
+    assert(r->data != NULL);
+    sprintf(fname,"%s.ovflow",name);
+    r->ovflow = openFile(fname,fileMode(r,mode,fmode));
+    assert(r->ovflow != NULL);
+    r->dict = NULL;
+    if (hasDict(r)) {
+        r->dict = openDict(name,mode,r->nattrs);
+        assert(r->dict != NULL);
+    }
+    r->heap = NULL;
+    if (r->flags & RELN_OUTOFLINE) {
+        r->heap = openHeap(name,mode);
+        assert(r->heap != NULL);
+    }
+    r->mode = (mode[0] == 'w' || strchr(mode,'+') != NULL) ? 'w' : 'r';
+    memset(r->counts, 0, sizeof(r->counts));
+    snprintf(r->name, MAXFILENAME, "%s", name);
+    r->arena = newArena();
+    // a relation being updated needs its summary and sketches; otherwise
+    //   they're only loaded (or built) if they're wanted, by relnSummary
+    //   and relnSketch
+    r->sum = NULL;
+    r->sketch = NULL;
+    if (r->mode == 'w') {
+        r->sum = loadSummary(name, r->npages, r->ntups);
+        r->sketch = loadSketch(name, r->nattrs, r->ntups);
+        Summary sum = (r->sum == NULL) ? newSummary() : NULL;
+        Sketch sk = (r->sketch == NULL) ? newSketch(r->nattrs) : NULL;
+        if (sum != NULL || sk != NULL) scanRelation(r, sum, sk);
+        if (sum != NULL) r->sum = sum;
+        if (sk != NULL) r->sketch = sk;
+    }
     return r;
 }
 
 // release files and descriptor for an open relation
 // copy latest information to .info file
+// if MALH_COUNTS is set (to "text" or "json"), the relation's counts
+//   are printed on stderr first, and if MALH_LATENCY is set, the
+//   latencies of operations since the last report are printed last
 
 void closeRelation(Reln r)
 {
+    char *format = getenv("MALH_COUNTS");
+    if (format != NULL) printCounts(r, format, stderr);
     // make sure updated global data is put in info
     // Naughty: assumes Count and Offset are the same size
     if (r->mode == 'w') {
@@ -107,11 +279,35 @@ void closeRelation(Reln r)
         // write out choice vector
         n = fwrite(r->cv, sizeof(ChVecItem), MAXCHVEC, r->info);
         assert(n == MAXCHVEC);
+        // write out attribute storage
+        n = fwrite(r->enc, 1, MAXATTRS, r->info);
+        assert(n == MAXATTRS);
+        n = fwrite(&r->flags, sizeof(Count), 1, r->info);
+        assert(n == 1);
+        n = fwrite(&r->version, sizeof(Count), 1, r->info);
+        assert(n == 1);
+        n = fwrite(&r->debt, sizeof(Count), 1, r->info);
+        assert(n == 1);
+        n = fwrite(&r->ahead, sizeof(Count), 1, r->info);
+        assert(n == 1);
+        n = fwrite(&r->key, sizeof(Count), 1, r->info);
+        assert(n == 1);
+        n = fwrite(&r->freelist, sizeof(PageID), 1, r->info);
+        assert(n == 1);
+        saveSummary(r->sum, r->name, r->ntups);
+        saveSketch(r->sketch, r->name, r->ntups);
     }
+    if (r->sum != NULL) freeSummary(r->sum);
+    if (r->sketch != NULL) freeSketch(r->sketch);
+    freeArena(r->arena);
+    if (r->dict != NULL) closeDict(r->dict);
+    if (r->heap != NULL) closeHeap(r->heap);
     fclose(r->info);
-    fclose(r->data);
-    fclose(r->ovflow);
+    closeFile(r->data);
+    closeFile(r->ovflow);
     free(r);
+    format = getenv("MALH_LATENCY");
+    if (format != NULL) traceReport(format, stderr);
 }
 
 // insert a new tuple into a relation
@@ -132,306 +328,368 @@ int needSplit(Reln r){
 }
 
 
-int tupsInPageAndOV(Reln r,int pid){
-    int result = 0;
-
-    Page cur = getPage(dataFile(r),pid);
-    result += pageNTuples(cur);
-    int ov = pageOvflow(cur);
-    free(cur);
-    while(ov != -1){
-
-        cur = getPage(ovflowFile(r),ov);
-        result += pageNTuples(cur);
-        ov = pageOvflow(cur);
-        free(cur);
-    }
-    return result;
-}
-
-char **allTups(Reln r){
-    char **tups = malloc(sizeof(char *)*tupsInPageAndOV(r,r->sp));
-    Page sp = getPage(dataFile(r),r->sp);
-    Offset cur = 1;
-    Offset cur_data = 0;
-    int counter = 0;
-    while(cur <= pageNTuples(sp)){
-        int tup_len = strlen(&pageData(sp)[cur_data]);
-        char *tup = malloc(sizeof(char)*(tup_len+1));
-        strcpy(tup,&pageData(sp)[cur_data]);
-        tup[tup_len] = '\0';
-        tups[counter] = tup;
-        cur_data+=tup_len+1;
-        cur++;
-        counter++;
-    }
-    int ov = pageOvflow(sp);
-    free(sp);
-
-    while(ov!=-1){
-        cur = 1;
-        cur_data = 0;
-        Page cur_page = getPage(ovflowFile(r),ov);
-        while(cur <= pageNTuples(cur_page)){
-            int tup_len = strlen(&pageData(cur_page)[cur_data]);
-            char *tup = malloc(sizeof(char)*(tup_len+1));
-            strcpy(tup,&pageData(cur_page)[cur_data]);
-            tup[tup_len] = '\0';
-            tups[counter] = tup;
-            cur_data+=tup_len+1;
-            cur++;
-            counter++;
+// find a fresh overflow page to follow page tail in a bucket's chain
+// tail is NO_PAGE when the chain currently ends at the primary page
+// overflow pages are handed out in extents of OVEXTENT adjacent pages,
+//   so that one bucket's chain occupies runs of consecutive pages;
+//   if the page after tail is still RESERVED, it belongs to tail's
+//   extent (the first page of an extent is always used immediately)
+// otherwise, pages freed by splits are used before a new extent
+// returns the new PageID and an in-memory buffer for it in *pg
+
+PageID newOvflowPage(Reln r, PageID tail, Page *pg)
+{
+    if (tail != NO_PAGE && tail+1 < filePages(r->ovflow)) {
+        Page p = getPage(r->ovflow, tail+1);
+        if (pageOvflow(p) == RESERVED) {
+            pageSetOvflow(p, NO_PAGE);
+            *pg = p;
+            return tail+1;
+        }
+        free(p);
+    }
+    if (r->freelist != NO_PAGE) {
+        PageID pid = r->freelist;
+        Page p = getPage(r->ovflow, pid);
+        r->freelist = pageOvflow(p);
+        pageSetOvflow(p, NO_PAGE);
+        *pg = p;
+        return pid;
+    }
+    *pg = newPage();
+    return addExtent(r->ovflow, OVEXTENT);
+}
+
+// put overflow page pid, no longer in any chain, on the free list
+// a free page is empty, and its ovflow field links to the next one
+
+static void freeOvflowPage(Reln r, PageID pid)
+{
+    Page p = newPage();
+    pageSetOvflow(p, r->freelist);
+    putPage(r->ovflow, pid, p);
+    r->freelist = pid;
+}
+
+// free the pages still RESERVED after tail, once tail is no longer
+//   the end of a chain that could grow into them
+
+static void freeReserved(Reln r, PageID tail)
+{
+    for (PageID pid = tail+1; pid < filePages(r->ovflow); pid++) {
+        Page p = getPage(r->ovflow, pid);
+        Bool reserved = (pageOvflow(p) == RESERVED);
+        free(p);
+        if (!reserved) break;
+        freeOvflowPage(r, pid);
+    }
+}
+
+// add a record to a page in bucket b's chain, keeping b's summary
+// a new page in the chain is counted (with its free space) first
+
+static Status addToChain(Reln r, BucketSum *b, Page pg, Bool newpage,
+                         char *rec, Count len)
+{
+    Count before = pageFreeSpace(pg);
+    if (addRecord(r,pg,rec,len) != OK) return ~OK;
+    if (newpage) { b->npages++; b->free += before; }
+    b->free -= before - pageFreeSpace(pg);
+    b->ntups++;
+    return OK;
+}
+
+// insert a tuple record of len bytes into the bucket whose
+//   primary data page is p
+// scan overflow chain until we find space
+// worst case: add new ovflow page at end of chain
+// returns OK, or ~OK if the tuple won't fit even in an empty page
+
+Status insertIntoBucket(Reln r, PageID p, char *rec, Count len)
+{
+    BucketSum *b = bucketSum(r->sum, p);
+    Page pg = getPage(r->data,p);
+    if (addToChain(r,b,pg,FALSE,rec,len) == OK) {
+        putPage(r->data,p,pg);
+        return OK;
+    }
+    // primary data page full
+    PageID ovp = pageOvflow(pg);
+    if (ovp == NO_PAGE) {
+        // add first overflow page in chain
+        Page newpg;
+        PageID newp = newOvflowPage(r, NO_PAGE, &newpg);
+        // can't add to a new page; we have a problem
+        if (addToChain(r,b,newpg,TRUE,rec,len) != OK) { free(pg); free(newpg); return ~OK; }
+        putPage(r->ovflow,newp,newpg);
+        pageSetOvflow(pg,newp);
+        putPage(r->data,p,pg);
+        return OK;
+    }
+    free(pg);
+    PageID prevp = NO_PAGE;
+    Page prevpg = NULL;
+    while (ovp != NO_PAGE) {
+        Page ovpg = getPage(r->ovflow, ovp);
+        if (addToChain(r,b,ovpg,FALSE,rec,len) == OK) {
+            if (prevpg != NULL) free(prevpg);
+            putPage(r->ovflow,ovp,ovpg);
+            return OK;
         }
-        ov = pageOvflow(cur_page);
-        free(cur_page);
+        if (prevpg != NULL) free(prevpg);
+        prevp = ovp;
+        prevpg = ovpg;
+        ovp = pageOvflow(ovpg);
     }
-    return tups;
+    // all overflow pages are full; add another to chain
+    // at this point, there *must* be a prevpg
+    assert(prevpg != NULL);
+    Page newpg;
+    PageID newp = newOvflowPage(r, prevp, &newpg);
+    if (addToChain(r,b,newpg,TRUE,rec,len) != OK) { free(prevpg); free(newpg); return ~OK; }
+    putPage(r->ovflow,newp,newpg);
+    // link to existing overflow chain
+    pageSetOvflow(prevpg,newp);
+    putPage(r->ovflow,prevp,prevpg);
+    return OK;
 }
 
-void cleanPage(Reln r,int pid){
-    //clean page and ov
+// a chain of pages being filled in memory (see splitBucket)
 
-    Page cur = getPage(dataFile(r),pid);
+typedef struct {
+    int    n, max;
+    Page  *pages;
+    PageID *ids;
+} Chain;
 
-    Offset ov = pageOvflow(cur);
-    pageClean(cur);
-    putPage(dataFile(r),pid,cur);
-    while (ov != NO_PAGE){
+static void chainInit(Chain *c)
+{
+    c->n = 0; c->max = 4;
+    c->pages = malloc(c->max*sizeof(Page));
+    c->ids = malloc(c->max*sizeof(PageID));
+    assert(c->pages != NULL && c->ids != NULL);
+}
 
-        cur = getPage(ovflowFile(r),ov);
-        int next = pageOvflow(cur);
-        pageClean(cur);
-        putPage(ovflowFile(r),ov,cur);
-        ov = next;
+static void chainAddPage(Chain *c, Page p, PageID id)
+{
+    if (c->n == c->max) {
+        c->max *= 2;
+        c->pages = realloc(c->pages, c->max*sizeof(Page));
+        c->ids = realloc(c->ids, c->max*sizeof(PageID));
+        assert(c->pages != NULL && c->ids != NULL);
     }
+    c->pages[c->n] = p;
+    c->ids[c->n++] = id;
 }
 
-PageID addToRelation(Reln r, Tuple t)
+// add a record to the last page of a chain, or to a new page
+// ids of new pages are assigned later
+
+static void chainAdd(Reln r, Chain *c, char *rec, Count len)
 {
-    if (needSplit(r)){
-
-        int total_tups = tupsInPageAndOV(r,r->sp);
-        char **tups = allTups(r);
-        //Tuple tup;
-        int n_pid = addPage(r->data);
-        r->npages++;
-        cleanPage(r,r->sp);
-        //cleanPage;
-        for(int i= 0;i<total_tups;i++){
-            Bits hash= tupleHashNoPrint(r,tups[i]);
-            Bits lower = getLower(hash,r->depth+1);
-            if(bitIsSet(lower,r->depth)){
-                //insert to new page
-                Page pg = getPage(r->data,n_pid);
-                if (addToPage(pg,tups[i]) == OK) {
-                    putPage(r->data,n_pid,pg);
-                    continue;
-                }
-                // primary data page full
-                if (pageOvflow(pg) == NO_PAGE) {
-                    // add first overflow page in chain
-                    PageID newp = addPage(r->ovflow);
-                    pageSetOvflow(pg,newp);
-                    putPage(r->data,n_pid,pg);
-                    Page newpg = getPage(r->ovflow,newp);
-                    // can't add to a new page; we have a problem
-                    if (addToPage(newpg,tups[i]) != OK) return NO_PAGE;
-                    putPage(r->ovflow,newp,newpg);
-                    continue;
-                }
-                else {
-                    // scan overflow chain until we find space
-                    // worst case: add new ovflow page at end of chain
-                    Page ovpg, prevpg = NULL;
-                    PageID ovp, prevp = NO_PAGE;
-                    ovp = pageOvflow(pg);
-                    free(pg);
-                    int ok = 0;
-                    while (ovp != NO_PAGE) {
-                        ovpg = getPage(r->ovflow, ovp);
-                        if (addToPage(ovpg,tups[i]) != OK) {
-                            prevp = ovp;
-                            if(prevpg){
-                                free(prevpg);
-                            }
-                            prevpg = ovpg;
-                            ovp = pageOvflow(ovpg);
-                        }
-                        else {
-                            if (prevpg != NULL) free(prevpg);
-                            putPage(r->ovflow,ovp,ovpg);
-                            ok = 1;
-                            break;
-                        }
-                    }
-                    // all overflow pages are full; add another to chain
-                    // at this point, there *must* be a prevpg
-                    if(ok==0){
-                        assert(prevpg != NULL);
-                        // make new ovflow page
-
-                        PageID newp = addPage(r->ovflow);
-                        //printf("b new:%d\n",newp);
-
-                        // insert tuple into new page
-                        Page newpg = getPage(r->ovflow,newp);
-                        if (addToPage(newpg,t) != OK) return NO_PAGE;
-                        putPage(r->ovflow,newp,newpg);
-                        // link to existing overflow chain
-                        pageSetOvflow(prevpg,newp);
-                        putPage(r->ovflow,prevp,prevpg);
-                    }
-
-                }
-            }else{
-                //insert to sp page
-                Page pg = getPage(r->data,r->sp);
-                if (addToPage(pg,tups[i]) == OK) {
-                    putPage(r->data,r->sp,pg);
-                    continue;
-                }
-                if (pageOvflow(pg) == NO_PAGE) {
-                    // add first overflow page in chain
-                    PageID newp = addPage(r->ovflow);
-                    pageSetOvflow(pg,newp);
-                    putPage(r->data,r->sp,pg);
-                    Page newpg = getPage(r->ovflow,newp);
-                    // can't add to a new page; we have a problem
-                    if (addToPage(newpg,tups[i]) != OK) return NO_PAGE;
-                    putPage(r->ovflow,newp,newpg);
-                    continue;
-
-                }
-                else {
-                    // scan overflow chain until we find space
-                    // worst case: add new ovflow page at end of chain
-                    Page ovpg, prevpg = NULL;
-                    PageID ovp, prevp = NO_PAGE;
-                    ovp = pageOvflow(pg);
-                    free(pg);
-                    int ok = 0;
-                    while (ovp != NO_PAGE) {
-                        ovpg = getPage(r->ovflow, ovp);
-                        if (addToPage(ovpg, tups[i]) != OK) {
-                            prevp = ovp;
-                            if(prevpg){
-                                free(prevpg);
-                            }
-                            prevpg = ovpg;
-                            ovp = pageOvflow(ovpg);
-                        } else {
-                            if (prevpg != NULL) free(prevpg);
-                            putPage(r->ovflow, ovp, ovpg);
-                            ok = 1;
-                            break;
-                        }
-                    }
-                    // all overflow pages are full; add another to chain
-                    // at this point, there *must* be a prevpg
-                    //**********************************************
-                    if (ok !=1){
-                        assert(prevpg != NULL);
-
-                        PageID newp = addPage(r->ovflow);
-                        Page newpg = getPage(r->ovflow,newp);
-                        if (addToPage(newpg,t) != OK) return NO_PAGE;
-                        putPage(r->ovflow,newp,newpg);
-                        pageSetOvflow(prevpg,newp);
-                        putPage(r->ovflow,prevp,prevpg);
-
-                        continue;
-                    }
-
-                }
-            }
+    if (c->n > 0 && addRecord(r, c->pages[c->n-1], rec, len) == OK) return;
+    Page p = newPage();
+    // records came from a page, so they must fit in one
+    Status ok = addRecord(r, p, rec, len);
+    assert(ok == OK);
+    chainAddPage(c, p, NO_PAGE);
+}
+
+// give the pages of a chain their PageIDs: the first is the bucket's
+//   primary page pid, then overflow pages come from spare[*used..]
+//   (pages of the chain being split), and then newOvflowPage
+
+static void chainAssign(Reln r, Chain *c, PageID pid,
+                        PageID *spare, int nspare, int *used)
+{
+    if (c->n == 0) chainAddPage(c, newPage(), NO_PAGE);
+    c->ids[0] = pid;
+    for (int i = 1; i < c->n; i++) {
+        if (*used < nspare)
+            c->ids[i] = spare[(*used)++];
+        else {
+            Page tmp;
+            c->ids[i] = newOvflowPage(r, i > 1 ? c->ids[i-1] : NO_PAGE, &tmp);
+            free(tmp);
         }
+    }
+}
+
+// summarise a chain's pages in b
+
+static void chainSummary(Chain *c, BucketSum *b)
+{
+    b->ntups = b->free = 0;
+    b->npages = c->n;
+    for (int i = 0; i < c->n; i++) {
+        b->ntups += pageNTuples(c->pages[i]);
+        b->free += pageFreeSpace(c->pages[i]);
+    }
+}
+
+// link up a chain's pages and write each of them, once
+
+static void chainWrite(Reln r, Chain *c)
+{
+    for (int i = 0; i < c->n; i++) {
+        pageSetOvflow(c->pages[i], (i+1 < c->n) ? c->ids[i+1] : NO_PAGE);
+        putPage(i == 0 ? r->data : r->ovflow, c->ids[i], c->pages[i]);
+    }
+    free(c->pages);
+    free(c->ids);
+}
+
+// with RELN_ADAPTIVE, before the first split at a depth starts using
+//   choice vector position d, positions d.. are rewritten to suit the
+//   tuples inserted so far (see adaptChVec)
+// no bucket depends on those positions yet, so nothing has to move
+// a relation with a key keeps its choice vector, whose bits come from
+//   the key so that each key value has one bucket
+
+#define MINADAPT 1024  // tuples seen before the data is trusted
+
+static void adaptBits(Reln r)
+{
+    if (!(r->flags & RELN_ADAPTIVE) || r->ntups < MINADAPT) return;
+    if (r->key != NO_KEY) return;
+    adaptChVec(r->cv, r->depth, r->nattrs, r->sketch);
+}
 
-        r->sp++;
-        if(r->sp == pow(2,r->depth)){
-            r->sp=0;
-            r->depth++;
+// split the bucket at the split pointer
+// its tuples are redistributed between it and a new bucket
+//   at the end of the data file, based on hash bit d
+// the bucket's chain is read once, and the two new chains are built
+//   in memory and written once each; the old chain's overflow pages
+//   are reused, and any left over are freed, along with the rest of
+//   the old chain's last extent, which no chain can now grow into
+
+void splitBucket(Reln r)
+{
+    if (r->sp == 0) adaptBits(r);
+    long long t0 = traceStart();
+    PageID newp = r->npages;
+    Chain stay, move;
+    chainInit(&stay);
+    chainInit(&move);
+    PageID *spare = NULL;
+    int nspare = 0, maxspare = 0, used = 0;
+    PageID pid = r->sp;
+    Page pg = getPage(r->data, pid);
+    prefetchPages(r->ovflow, pageOvflow(pg), PREFETCH);
+    for (;;) {
+        RecScan s;
+        char *rec;
+        Count len;
+        startRecScan(r, pg, &s);
+        while ((rec = nextRecord(r, &s, &len)) != NULL) {
+            Bits hash = recordHash(r, rec);
+            resetArena(r->arena);
+            Bool moves = bitIsSet(hash,r->depth);
+            chainAdd(r, moves ? &move : &stay, rec, len);
+            relnCount(r, CNT_MOVED, moves);
         }
-        for(int i= 0;i<total_tups;i++){
-            free(tups[i]);
+        PageID ov = pageOvflow(pg);
+        free(pg);
+        if (ov == NO_PAGE) break;
+        if (nspare == maxspare) {
+            maxspare = (maxspare == 0) ? 8 : 2*maxspare;
+            spare = realloc(spare, maxspare*sizeof(PageID));
+            assert(spare != NULL);
         }
-        free(tups);
+        spare[nspare++] = ov;
+        pg = getPage(r->ovflow, ov);
+    }
+    chainAssign(r, &stay, r->sp, spare, nspare, &used);
+    chainAssign(r, &move, newp, spare, nspare, &used);
+    chainSummary(&stay, bucketSum(r->sum, r->sp));
+    chainSummary(&move, bucketSum(r->sum, newp));
+    chainWrite(r, &stay);
+    chainWrite(r, &move);
+    // spares are used in chain order, so the old tail is the last
+    if (used < nspare) freeReserved(r, spare[nspare-1]);
+    for (int i = used; i < nspare; i++) freeOvflowPage(r, spare[i]);
+    free(spare);
+    traceEnd(OP_SPLIT, t0, r->sp);
+    relnCount(r, CNT_SPLIT, 1);
+    r->npages++;
+    r->sp++;
+    if (r->sp == pow(2,r->depth)) {
+        r->sp = 0;
+        r->depth++;
+    }
+}
+
+// split the next k buckets in one pass, in order, e.g. to make room
+//   ahead of a large load
+// splits that are then due are not done again: they pay off any split
+//   debt first, and the rest are remembered, so that the next inserts
+//   that would split don't
+// returns the new number of data pages
+
+Count expandRelation(Reln r, Count k)
+{
+    // the buckets are read in order
+    Count run = ((Count)1 << r->depth) - r->sp;
+    prefetchPages(r->data, r->sp, (k < run) ? k : run);
+    for (Count i = 0; i < k; i++) splitBucket(r);
+    Count paid = (k < r->debt) ? k : r->debt;
+    r->debt -= paid;
+    r->ahead += k - paid;
+    return r->npages;
+}
+
+// carry out up to max of the relation's deferred splits
+// each is a bounded unit of work (one bucket's chain), and leaves
+//   the file consistent, as sp only moves once the bucket is split
+// returns the number of splits done
+
+Count paySplitDebt(Reln r, Count max)
+{
+    Count done = 0;
+    while (r->debt > 0 && done < max) {
+        splitBucket(r);
+        r->debt--;
+        done++;
     }
+    return done;
+}
+
+// in a RELN_DEFERSPLIT relation, a split that's due is only noted,
+//   to be done later by paySplitDebt (the split command), so that
+//   no insert pays for reading and rewriting a bucket
 
-    Bits h, p;
-    h = tupleHash(r,t);
+PageID addToRelation(Reln r, Tuple t)
+{
+    long long t0 = traceStart();
+    if (needSplit(r)) {
+        if (r->ahead > 0)
+            r->ahead--;  // already done by expandRelation
+        else if (r->flags & RELN_DEFERSPLIT)
+            r->debt++;
+        else
+            splitBucket(r);
+    }
+
+    Bits h, p, hashs[MAXATTRS];
+    char rec[MAXRECLEN];
+    Count len = tupleToRecord(r,t,rec);
+    h = tupleHash(r,t,hashs);
     if (r->depth == 0)
-        p = 1;
+        p = 0;
     else {
         p = getLower(h, r->depth);
         if (p < r->sp) p = getLower(h, r->depth+1);
     }
     // bitsString(h,buf); printf("hash = %s\n",buf);
     // bitsString(p,buf); printf("page = %s\n",buf);
-    Page pg = getPage(r->data,p);
-    if (addToPage(pg,t) == OK) {
-        putPage(r->data,p,pg);
+    Status ok = insertIntoBucket(r,p,rec,len);
+    if (ok == OK) {
         r->ntups++;
-        return p;
+        for (int i = 0; i < r->nattrs; i++) sketchAdd(r->sketch, i, hashs[i]);
     }
-    // primary data page full
-    if (pageOvflow(pg) == NO_PAGE) {
-        // add first overflow page in chain
-        PageID newp = addPage(r->ovflow);
-        //printf("new:%d\n",newp);
-        //printf("468\n");
-
-        pageSetOvflow(pg,newp);
-        putPage(r->data,p,pg);
-        Page newpg = getPage(r->ovflow,newp);
-        // can't add to a new page; we have a problem
-        if (addToPage(newpg,t) != OK) return NO_PAGE;
-        putPage(r->ovflow,newp,newpg);
-        r->ntups++;
-        return p;
-    } else {
-        // scan overflow chain until we find space
-        // worst case: add new ovflow page at end of chain
-        Page ovpg, prevpg = NULL;
-        PageID ovp, prevp = NO_PAGE;
-        ovp = pageOvflow(pg);
-        free(pg);
-        while (ovp != NO_PAGE) {
-            ovpg = getPage(r->ovflow, ovp);
-            if (addToPage(ovpg,t) != OK) {
-                prevp = ovp;
-                if(prevpg){
-                    free(prevpg);
-                }
-                prevpg = ovpg;
-                ovp = pageOvflow(ovpg);
-                //free(ovpg);
-            }
-            else {
-                if (prevpg != NULL) free(prevpg);
-                putPage(r->ovflow,ovp,ovpg);
-                r->ntups++;
-                return p;
-            }
-        }
-        // all overflow pages are full; add another to chain
-        // at this point, there *must* be a prevpg
-        assert(prevpg != NULL);
-        // make new ovflow page
-        PageID newp = addPage(r->ovflow);
-        //printf("new:%d\n",newp);
-        //printf("505\n");
-
-        // insert tuple into new page
-        Page newpg = getPage(r->ovflow,newp);
-        if (addToPage(newpg,t) != OK) return NO_PAGE;
-        putPage(r->ovflow,newp,newpg);
-        // link to existing overflow chain
-        pageSetOvflow(prevpg,newp);
-        putPage(r->ovflow,prevp,prevpg);
-        r->ntups++;
-        return p;
-    }
-    return NO_PAGE;
+    resetArena(r->arena);
+    traceEnd(OP_INSERT, t0, p);
+    return (ok == OK) ? p : NO_PAGE;
 }
 
 
@@ -439,25 +697,102 @@ PageID addToRelation(Reln r, Tuple t)
 
 // external interfaces for Reln data
 
-FILE *dataFile(Reln r) { return r->data; }
-FILE *ovflowFile(Reln r) { return r->ovflow; }
+File dataFile(Reln r) { return r->data; }
+File ovflowFile(Reln r) { return r->ovflow; }
 Count nattrs(Reln r) { return r->nattrs; }
 Count npages(Reln r) { return r->npages; }
 Count ntuples(Reln r) { return r->ntups; }
 Count depth(Reln r)  { return r->depth; }
 Count splitp(Reln r) { return r->sp; }
 ChVecItem *chvec(Reln r)  { return r->cv; }
+Byte attrEncoding(Reln r, int att) { return r->enc[att]; }
+Dict relnDict(Reln r) { return r->dict; }
+Heap relnHeap(Reln r) { return r->heap; }
+Count relnFlags(Reln r) { return r->flags; }
+Count relnVersion(Reln r) { return r->version; }
+
+// scratch space for a tuple operation: released when the tuple has
+//   been inserted, or moved by a split
+
+Arena relnArena(Reln r) { return r->arena; }
+
+// the relation's sketches of attribute values
+// a relation opened read-only loads them when first wanted, or builds
+//   them from the pages if the sketch file is missing or stale
+
+Sketch relnSketch(Reln r)
+{
+    if (r->sketch == NULL)
+        r->sketch = loadSketch(r->name, r->nattrs, r->ntups);
+    if (r->sketch == NULL) {
+        r->sketch = newSketch(r->nattrs);
+        scanRelation(r, NULL, r->sketch);
+    }
+    return r->sketch;
+}
+Count splitDebt(Reln r) { return r->debt; }
+Count keyAttr(Reln r) { return r->key; }
+
+// count n more units of some kind of work (CNT_*)
+// counts are updated atomically, as threads may share a relation
+
+void relnCount(Reln r, int what, Count n)
+{
+    __atomic_fetch_add(&r->counts[what], n, __ATOMIC_RELAXED);
+}
+
+Count relnCounted(Reln r, int what)
+{
+    return __atomic_load_n(&r->counts[what], __ATOMIC_RELAXED);
+}
+
+// print a relation's counts: pages read, written and appended in its
+//   data and overflow files, and the other work done while it's been
+//   open; format is "json" for a one-line JSON object, else text
+
+void printCounts(Reln r, char *format, FILE *out)
+{
+    Count dr, dw, da, or, ow, oa;
+    fileCounts(r->data, &dr, &dw, &da);
+    fileCounts(r->ovflow, &or, &ow, &oa);
+    Count *c = r->counts;
+    if (strcmp(format, "json") == 0) {
+        fprintf(out, "{\"relation\":\"%s\","
+                "\"data\":{\"reads\":%d,\"writes\":%d,\"appends\":%d},"
+                "\"ovflow\":{\"reads\":%d,\"writes\":%d,\"appends\":%d},"
+                "\"splits\":%d,\"moved\":%d,\"hashes\":%d,"
+                "\"compared\":%d}\n",
+                r->name, dr, dw, da, or, ow, oa, c[CNT_SPLIT],
+                c[CNT_MOVED], c[CNT_HASH], c[CNT_COMPARE]);
+        return;
+    }
+    fprintf(out, "Counts for %s:\n", r->name);
+    fprintf(out, "  data pages:     %d read, %d written, %d appended\n",
+            dr, dw, da);
+    fprintf(out, "  overflow pages: %d read, %d written, %d appended\n",
+            or, ow, oa);
+    fprintf(out, "  splits: %d  tuples moved: %d\n",
+            c[CNT_SPLIT], c[CNT_MOVED]);
+    fprintf(out, "  values hashed: %d  bytes compared: %d\n",
+            c[CNT_HASH], c[CNT_COMPARE]);
+}
+
+// are records stored field by field? (see tuple.c)
+
+Bool isEncoded(Reln r)
+{
+    for (int i = 0; i < r->nattrs; i++)
+        if (r->enc[i] != ATT_TEXT) return TRUE;
+    return r->version >= 2 || (r->flags & (RELN_PAX|RELN_OUTOFLINE)) != 0;
+}
 
 
 // displays info about open Reln
 
-void relationStats(Reln r)
+// print each bucket's chain of pages, reading every page
+
+static void pageStats(Reln r)
 {
-    printf("Global Info:\n");
-    printf("#attrs:%d  #pages:%d  #tuples:%d  d:%d  sp:%d\n",
-           r->nattrs, r->npages, r->ntups, r->depth, r->sp);
-    printf("Choice vector\n");
-    printChVec(r->cv);
     printf("Bucket Info:\n");
     printf("%-4s %s\n","#","Info on pages in bucket");
     printf("%-4s %s\n","","(pageID,#tuples,freebytes,ovflow)");
@@ -481,3 +816,165 @@ void relationStats(Reln r)
         putchar('\n');
     }
 }
+
+// is bucket a worse than bucket b? (longer chain, then more tuples)
+
+static Bool worseBucket(BucketSum *a, BucketSum *b)
+{
+    if (a->npages != b->npages) return a->npages > b->npages;
+    return a->ntups > b->ntups;
+}
+
+// print the shape of the buckets, from the relation's summary:
+//   load factor, overflow ratio, histogram of chain lengths, and the
+//   ntop buckets with the longest chains (or every bucket, if all)
+
+// the relation's bucket summary, loaded or built as for relnSketch
+
+static Summary relnSummary(Reln r)
+{
+    if (r->sum == NULL)
+        r->sum = loadSummary(r->name, r->npages, r->ntups);
+    if (r->sum == NULL) {
+        r->sum = newSummary();
+        scanRelation(r, r->sum, NULL);
+    }
+    return r->sum;
+}
+
+static void bucketStats(Reln r, Count ntop, Bool all)
+{
+    Summary s = relnSummary(r);
+    Count nb = r->npages, npages = 0, maxlen = 0;
+    long long ntups = 0, nfree = 0;
+    for (PageID b = 0; b < nb; b++) {
+        BucketSum *e = bucketSum(s, b);
+        ntups += e->ntups; npages += e->npages; nfree += e->free;
+        if (e->npages > maxlen) maxlen = e->npages;
+    }
+    long long room = (long long)npages * emptyPageFree();
+    printf("Bucket Info:\n");
+    printf("#buckets:%d  #pages:%d  #ovflow:%d  tuples/bucket:%.1f\n",
+           nb, npages, npages-nb, nb > 0 ? (double)ntups/nb : 0.0);
+    printf("Load factor: %.2f  (%lld of %lld bytes used)"
+           "  Overflow ratio: %.2f\n",
+           room > 0 ? (double)(room-nfree)/room : 0.0, room-nfree, room,
+           nb > 0 ? (double)(npages-nb)/nb : 0.0);
+    printf("Chain lengths:\n");
+    Count *hist = calloc(maxlen+1, sizeof(Count));
+    assert(hist != NULL);
+    for (PageID b = 0; b < nb; b++) hist[bucketSum(s, b)->npages]++;
+    for (Count len = 1; len <= maxlen; len++)
+        if (hist[len] > 0)
+            printf("%4d page%s %6d bucket%s\n", len, len == 1 ? " " : "s",
+                   hist[len], hist[len] == 1 ? "" : "s");
+    free(hist);
+    if (all) {
+        printf("%-5s %s\n","#","(#pages,#tuples,freebytes)");
+        for (PageID b = 0; b < nb; b++) {
+            BucketSum *e = bucketSum(s, b);
+            printf("[%2d]  (%d,%d,%d)\n", b, e->npages, e->ntups, e->free);
+        }
+    }
+    else if (ntop > 0) {
+        // keep the worst ntop buckets seen so far, worst first
+        if (ntop > nb) ntop = nb;
+        PageID *top = malloc(ntop*sizeof(PageID));
+        assert(top != NULL);
+        Count n = 0;
+        for (PageID b = 0; b < nb; b++) {
+            BucketSum *e = bucketSum(s, b);
+            if (n == ntop && !worseBucket(e, bucketSum(s, top[n-1])))
+                continue;
+            Count i = (n < ntop) ? n++ : n-1;
+            for (; i > 0 && worseBucket(e, bucketSum(s, top[i-1])); i--)
+                top[i] = top[i-1];
+            top[i] = b;
+        }
+        printf("Worst buckets:\n");
+        printf("%-5s %s\n","#","(#pages,#tuples,freebytes)");
+        for (Count i = 0; i < n; i++) {
+            BucketSum *e = bucketSum(s, top[i]);
+            printf("[%2d]  (%d,%d,%d)\n", top[i], e->npages, e->ntups, e->free);
+        }
+        free(top);
+    }
+}
+
+// print the estimated number of distinct values of each attribute,
+//   and how many of the choice vector's bits in use are from it
+// an attribute with far fewer values than its bits can address leaves
+//   buckets empty (or others overfull)
+
+static void sketchStats(Reln r)
+{
+    Sketch sk = relnSketch(r);
+    Count used = r->depth + (r->sp > 0 ? 1 : 0);
+    printf("Attribute values (estimated distinct, hash bits in use):\n");
+    for (int i = 0; i < r->nattrs; i++) {
+        Count nbits = 0;
+        for (Count j = 0; j < used; j++)
+            if (r->cv[j].att == i) nbits++;
+        double ndv = sketchDistinct(sk, i);
+        printf("%4d: ~%.0f values, %d bit%s%s\n", i, ndv, nbits,
+               nbits == 1 ? "" : "s",
+               ldexp(1.0, nbits) > 2*ndv ? "  (more bits than values)" : "");
+    }
+    printf("Skewed choice vector bits:");
+    Count nskew = 0;
+    for (Count j = 0; j < MAXCHVEC; j++) {
+        ChVecItem *c = &r->cv[j];
+        if (balancedBit(sk, c->att, c->bit)) continue;
+        printf(" %d(%d,%d):%.2f", j, c->att, c->bit,
+               sketchBalance(sk, c->att, c->bit));
+        nskew++;
+    }
+    printf(nskew == 0 ? " none\n" : "\n");
+}
+
+// print information about a relation and its buckets
+// the buckets are described by the summary (with the ntop worst
+//   buckets, or all of them), or page by page if pages is set
+
+void relationStats(Reln r, Count ntop, Bool all, Bool pages)
+{
+    printf("Global Info:\n");
+    printf("#attrs:%d  #pages:%d  #tuples:%d  d:%d  sp:%d  format:v%d\n",
+           r->nattrs, r->npages, r->ntups, r->depth, r->sp, r->version);
+    if (r->flags & RELN_COMPRESSED) {
+        long long dst, dlog, ost, olog;
+        fileUsage(r->data, &dst, &dlog);
+        fileUsage(r->ovflow, &ost, &olog);
+        printf("Compression: %lld bytes stored for %lld bytes of pages"
+               "  (ratio %.2f)\n", dst+ost, dlog+olog,
+               (dst+ost > 0) ? (double)(dlog+olog)/(dst+ost) : 1.0);
+    }
+    Bool typed = FALSE;
+    for (int i = 0; i < r->nattrs; i++)
+        if (r->enc[i] != ATT_TEXT) typed = TRUE;
+    if (typed) {
+        static char *encName[] = { "text", "text(dict)", "int32", "int64" };
+        printf("Attributes:");
+        for (int i = 0; i < r->nattrs; i++)
+            printf(" %d:%s", i, encName[r->enc[i]]);
+        putchar('\n');
+    }
+    if (r->key != NO_KEY)
+        printf("Key attribute: %d\n", r->key);
+    if (r->flags & RELN_DEFERSPLIT)
+        printf("Deferred splits: %d pending\n", r->debt);
+    if (r->flags & RELN_ADAPTIVE)
+        printf("Adaptive choice vector: positions %d.. may change\n",
+               r->depth + (r->sp > 0));
+    if (r->ahead > 0)
+        printf("Splits done ahead (by expand): %d\n", r->ahead);
+    if (r->heap != NULL)
+        printf("Value heap: %lld bytes\n", heapSize(r->heap));
+    printf("Choice vector\n");
+    printChVec(r->cv);
+    sketchStats(r);
+    if (pages)
+        pageStats(r);
+    else
+        bucketStats(r, ntop, all);
+}
@@ -11,19 +11,66 @@ typedef struct RelnRep *Reln;
 #include "tuple.h"
 #include "page.h"
 #include "chvec.h"
+#include "dict.h"
+#include "heap.h"
+#include "sketch.h"
+#include "arena.h"
 
-Status newRelation(char *name, Count nattr, Count npages, Count d, char *cv);
+// how attribute values are stored in records (see tuple.c)
+#define ATT_TEXT 0   // the value itself
+#define ATT_DICT 1   // id of the value in the relation's dictionary
+#define ATT_INT32 2  // 32-bit integer value, in binary
+#define ATT_INT64 3  // 64-bit integer value, in binary
+
+// relation options (bits in flags)
+#define RELN_COMPRESSED 0x1   // pages are stored compressed
+#define RELN_PAX        0x2   // pages hold a minipage per attribute
+#define RELN_OUTOFLINE  0x4   // long values are kept in a value heap
+#define RELN_DEFERSPLIT 0x8   // inserts record split debt; see split.c
+#define RELN_ADAPTIVE   0x10  // unused choice vector bits follow the data
+
+// kinds of work counted for each open relation (see relnCount)
+#define CNT_HASH    0   // values hashed
+#define CNT_COMPARE 1   // bytes compared while matching queries
+#define CNT_SPLIT   2   // buckets split
+#define CNT_MOVED   3   // tuples moved to new buckets by splits
+#define NCOUNTS     4
+
+// no key attribute
+#define NO_KEY 0xffffffff
+
+// record format of new relations (see tuple.c)
+#define RECVERSION 2
+
+Status newRelation(char *name, Count nattr, Count npages, Count d, char *cv,
+                   Byte *enc, Count flags, Count key);
 Reln openRelation(char *name, char *mode);
 void closeRelation(Reln r);
 Bool existsRelation(char *name);
 PageID addToRelation(Reln r, Tuple t);
-FILE *dataFile(Reln r);
-FILE *ovflowFile(Reln r);
+File dataFile(Reln r);
+File ovflowFile(Reln r);
 Count nattrs(Reln r);
 Count npages(Reln r);
+Count ntuples(Reln r);
 Count depth(Reln r);
 Count splitp(Reln r);
 ChVecItem *chvec(Reln r);
-void relationStats(Reln r);
+Byte attrEncoding(Reln r, int att);
+Bool isEncoded(Reln r);
+Dict relnDict(Reln r);
+Heap relnHeap(Reln r);
+Count relnFlags(Reln r);
+Count relnVersion(Reln r);
+Arena relnArena(Reln r);
+Sketch relnSketch(Reln r);
+Count splitDebt(Reln r);
+Count keyAttr(Reln r);
+void relnCount(Reln r, int what, Count n);
+Count relnCounted(Reln r, int what);
+void printCounts(Reln r, char *format, FILE *out);
+Count paySplitDebt(Reln r, Count max);
+Count expandRelation(Reln r, Count k);
+void relationStats(Reln r, Count ntop, Bool all, Bool pages);
 
 #endif
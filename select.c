@@ -1,16 +1,52 @@
 // select.c ... run queries
 // part of Multi-attribute linear-hashed files
 // Ask a query on a named relation
-// Usage:  ./select  [-v]  RelName  v1,v2,v3,v4,...
+// Usage:  ./select  [-v]  [-x | -a]  [-d]  [-p atts]  [-l n | -e]  [-c | -u att | -g att]  RelName  v1,v2,v3,v4,...
 // where any of the vi's can be "?" (unknown)
+// -x prints the query's plan (hash bits, candidate buckets, estimated
+//   pages) without running it
+// -a runs the query, then prints what it read and how long each phase
+//   took, on stderr
+// -v prints the plan on stderr, then runs the query
+// -d reads pages with O_DIRECT, bypassing the kernel page cache
+// -p atts prints just the attributes in the comma-separated list atts
+//   (e.g. -p 2,0), in that order
+// -l n stops after the first n matching tuples
+// -e prints "yes" if any tuple matches, else "no"
+// -c prints the number of matching tuples, rather than the tuples
+// -u att prints the number of distinct values of attribute att
+//   in the matching tuples
+// -g att prints "value,count" for each value of attribute att
+//   in the matching tuples
 
 #include "defs.h"
 #include "query.h"
 #include "tuple.h"
 #include "reln.h"
 #include "chvec.h"
+#include <unistd.h>
 
-#define USAGE "./select  [-v]  RelName  v1,v2,v3,v4,..."
+#define USAGE "./select  [-v]  [-x | -a]  [-d]  [-p atts]  [-l n | -e]  [-c | -u att | -g att]  RelName  v1,v2,v3,v4,..."
+
+// set atts[] from a projection list "a,b,..."
+// returns the number of attributes, or -1 if the list is invalid
+
+static int parseProjection(char *list, int nattrs, int *atts)
+{
+	char *c = list;
+	int n = 0;
+	while (*c != '\0') {
+		char *end;
+		long a = strtol(c, &end, 10);
+		if (end == c || a < 0 || a >= nattrs) return -1;
+		if (*end != ',' && *end != '\0') return -1;
+		if (*end == ',' && end[1] == '\0') return -1;
+		if (n == MAXATTRS) return -1;
+		atts[n++] = a;
+		c = (*end == ',') ? end+1 : end;
+	}
+	return (n > 0) ? n : -1;
+}
 
 // Main ... process args, run query
 
@@ -18,23 +54,41 @@ int main(int argc, char **argv)
 {
 	Reln r;  // handle on the open relation
 	Query q;  // processed version of query string
-	Tuple t;  // tuple pointer
 	char err[MAXERRMSG];  // buffer for error messages
-	int verbose;  // show extra info on query progress
+	int verbose = 0;  // show extra info on query progress
+	char mode = 0;  // 'x' to explain, 'a' to analyze
+	int direct = 0;  // use O_DIRECT for page I/O
+	char agg = 0;  // aggregate to compute: 'c', 'u' or 'g', if any
+	int att = 0;  // attribute for -u or -g
+	int limit = -1;  // max number of matches (-1 if no limit)
+	char *proj = NULL;  // projection list
+	int atts[MAXATTRS];  // attributes to print
+	int natts = 0;  // number of them (0 => all)
 	char *rname;  // name of table/file
 	char *qstr;   // query string
+	int opt;
 
 	// process command-line args
 
-	if (argc < 3) fatal(USAGE);
-	if (strcmp(argv[1], "-v") == 0) {
-		verbose = 1;  rname = argv[2];  qstr = argv[3];
-	}
-	else {
-		verbose = 0;  rname = argv[1];  qstr = argv[2];
+	while ((opt = getopt(argc, argv, "+vxadcu:g:l:ep:")) != -1) {
+		switch (opt) {
+		case 'v': verbose = 1; break;
+		case 'x': case 'a': mode = opt; break;
+		case 'd': direct = 1; break;
+		case 'c': agg = 'c'; break;
+		case 'e': agg = 'e'; break;
+		case 'p': proj = optarg; break;
+		case 'l':
+			limit = atoi(optarg);
+			if (limit < 0) fatal(USAGE);
+			break;
+		case 'u': case 'g':
+			agg = opt; att = atoi(optarg); break;
+		default:  fatal(USAGE);
+		}
 	}
-
-	if (verbose) { /* keeps compiler quiet */ }
+	if (argc - optind < 2) fatal(USAGE);
+	rname = argv[optind];  qstr = argv[optind+1];
 
 	// initialise relation and scanning structure
 
@@ -42,22 +96,48 @@ int main(int argc, char **argv)
 		sprintf(err, "No such relation: %s",rname);
 		fatal(err);
 	}
-	if ((r = openRelation(rname,"r")) == NULL) {
+	if ((r = openRelation(rname, direct ? "rd" : "r")) == NULL) {
 		sprintf(err, "Can't open relation: %s",rname);
 		fatal(err);
 	}
+	if ((agg == 'u' || agg == 'g') && (att < 0 || att >= nattrs(r))) {
+		sprintf(err, "Invalid attribute: %d",att);
+		fatal(err);
+	}
+	if (proj != NULL && (natts = parseProjection(proj, nattrs(r), atts)) < 0) {
+		sprintf(err, "Invalid projection: %.64s",proj);
+		fatal(err);
+	}
 	if ((q = startQuery(r, qstr)) == NULL) {	
 		sprintf(err, "Invalid query: %s",qstr);
 		fatal(err);
 	}
 
-	// execute the query (find matching tuples)
+	// show the plan, or execute the query (find matching tuples)
 
-	char tup[MAXTUPLEN];
-	while ((t = getNextTuple(q)) != NULL) {
-		tupleString(t,tup);
-		printf("%s\n",tup);
+	if (limit >= 0) limitQuery(q, limit);
+	if (mode == 'x') {
+		explainQuery(q, stdout);
+		closeQuery(q);
+		closeRelation(r);
+		return 0;
+	}
+	if (verbose) explainQuery(q, stderr);
+	if (mode == 'a') analyzeQuery(q);
+	if (agg == 'e') {
+		limitQuery(q, 1);
+		printf("%s\n", countQuery(q) > 0 ? "yes" : "no");
 	}
+	else if (agg == 'c')
+		printf("%d\n", countQuery(q));
+	else if (agg == 'u')
+		printf("%d\n", countDistinct(q, att));
+	else if (agg == 'g')
+		groupCount(q, att, stdout);
+	else
+		writeQuery(q, atts, natts, stdout);
+
+	if (mode == 'a') queryStats(q, stderr);
 
 	// clean up
 
@@ -0,0 +1,132 @@
+// sketch.c ... distinct-value sketches of a relation's attributes
+// part of Multi-attribute Linear-hashed Files
+// A HyperLogLog sketch estimates the number of distinct values of an
+//   attribute from the hashes of its values, in a fixed 1K bytes
+// The top SKBITS bits of a hash choose a register, which keeps the
+//   largest number of leading zeroes (plus 1) seen in the rest of the
+//   hash; the estimate is from the harmonic mean of 2^register, and is
+//   usually within a few percent of the true count
+// Each attribute also counts how often each bit of its hashes is set;
+//   a bit that's set in far more or fewer than half of the tuples
+//   can't split buckets evenly (see adaptChVec)
+// The sketch file (R.sketch) holds the number of attributes and of
+//   tuples when it was written, then each attribute's registers, and
+//   its hash and bit counts; if
+//   they don't match the relation, the sketches are rebuilt from it
+
+#include "defs.h"
+#include "sketch.h"
+#include <math.h>
+
+#define SKBITS 10
+#define NREGS  (1<<SKBITS)
+
+struct SketchRep {
+	Count nattrs;             // number of attributes sketched
+	Byte  regs[MAXATTRS][NREGS];
+	Count nhashes[MAXATTRS];  // hashes added, for each attribute
+	Count ones[MAXATTRS][MAXBITS]; // hashes with each bit set
+};
+
+// empty sketches for nattrs attributes
+
+Sketch newSketch(Count nattrs)
+{
+	Sketch s = calloc(1, sizeof(struct SketchRep));
+	assert(s != NULL);
+	s->nattrs = nattrs;
+	return s;
+}
+
+// read a relation's sketch file
+// returns NULL if there's none, or it's not for nattrs and ntups
+
+Sketch loadSketch(char *name, Count nattrs, Count ntups)
+{
+	char fname[MAXFILENAME];
+	sprintf(fname,"%s.sketch",name);
+	FILE *f = fopen(fname,"r");
+	if (f == NULL) return NULL;
+	Count hdr[2];
+	if (fread(hdr, sizeof(Count), 2, f) != 2 ||
+	    hdr[0] != nattrs || hdr[1] != ntups) {
+		fclose(f);
+		return NULL;
+	}
+	Sketch s = newSketch(nattrs);
+	Count n = fread(s->regs, NREGS, nattrs, f);
+	n += fread(s->nhashes, sizeof(Count), nattrs, f);
+	n += fread(s->ones, sizeof(Count)*MAXBITS, nattrs, f);
+	fclose(f);
+	if (n != 3*nattrs) { freeSketch(s); return NULL; }
+	return s;
+}
+
+// write a relation's sketch file
+
+void saveSketch(Sketch s, char *name, Count ntups)
+{
+	char fname[MAXFILENAME];
+	sprintf(fname,"%s.sketch",name);
+	FILE *f = fopen(fname,"w");
+	assert(f != NULL);
+	Count hdr[2] = { s->nattrs, ntups };
+	Count n = fwrite(hdr, sizeof(Count), 2, f);
+	assert(n == 2);
+	n = fwrite(s->regs, NREGS, s->nattrs, f);
+	n += fwrite(s->nhashes, sizeof(Count), s->nattrs, f);
+	n += fwrite(s->ones, sizeof(Count)*MAXBITS, s->nattrs, f);
+	assert(n == 3*s->nattrs);
+	fclose(f);
+}
+
+void freeSketch(Sketch s)
+{
+	free(s);
+}
+
+// add the hash of one of attribute att's values
+
+void sketchAdd(Sketch s, int att, Bits h)
+{
+	Count reg = h >> (32-SKBITS);
+	Bits rest = h << SKBITS;
+	// rank of first 1 bit in the rest (33-SKBITS if none)
+	Byte rank = 1;
+	while (rank <= 32-SKBITS && !(rest & 0x80000000)) {
+		rank++;
+		rest <<= 1;
+	}
+	if (rank > s->regs[att][reg]) s->regs[att][reg] = rank;
+	s->nhashes[att]++;
+	for (int i = 0; i < MAXBITS; i++)
+		s->ones[att][i] += (h >> i) & 1;
+}
+
+// fraction of attribute att's hashes with bit i set (0.5 if none)
+
+double sketchBalance(Sketch s, int att, int i)
+{
+	if (s->nhashes[att] == 0) return 0.5;
+	return (double)s->ones[att][i] / s->nhashes[att];
+}
+
+// estimated number of distinct values of attribute att
+
+double sketchDistinct(Sketch s, int att)
+{
+	double m = NREGS, sum = 0.0;
+	Count zeroes = 0;
+	for (Count i = 0; i < NREGS; i++) {
+		sum += ldexp(1.0, -s->regs[att][i]);
+		if (s->regs[att][i] == 0) zeroes++;
+	}
+	double est = (0.7213/(1.0 + 1.079/m)) * m * m / sum;
+	// few values: count of empty registers is more accurate
+	if (est <= 2.5*m && zeroes > 0)
+		est = m * log(m/zeroes);
+	// near 2^32 values: allow for hash collisions
+	else if (est > 4294967296.0/30)
+		est = -4294967296.0 * log(1.0 - est/4294967296.0);
+	return est;
+}
@@ -0,0 +1,21 @@
+// sketch.h ... interface to distinct-value sketches
+// part of Multi-attribute Linear-hashed Files
+// See sketch.c for details of Sketch type and functions
+
+#ifndef SKETCH_H
+#define SKETCH_H 1
+
+typedef struct SketchRep *Sketch;
+
+#include "defs.h"
+#include "bits.h"
+
+Sketch newSketch(Count nattrs);
+Sketch loadSketch(char *name, Count nattrs, Count ntups);
+void saveSketch(Sketch s, char *name, Count ntups);
+void freeSketch(Sketch s);
+void sketchAdd(Sketch s, int att, Bits h);
+double sketchDistinct(Sketch s, int att);
+double sketchBalance(Sketch s, int att, int i);
+
+#endif
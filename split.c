@@ -0,0 +1,54 @@
+// split.c ... carry out a Relation's deferred splits
+// part of Multi-attribute linear-hashed files
+// In a relation created with -S, inserts only count the bucket
+//   splits that are due; this does them, one bucket at a time
+// Usage:  ./split  [-v]  [-n N]  RelName
+// -n N does at most N splits (default: all that are pending), so that
+//   the work can be spread out, e.g. between batches of inserts
+
+#include "defs.h"
+#include "reln.h"
+#include <unistd.h>
+
+#define USAGE "./split  [-v]  [-n N]  RelName"
+
+// Main ... process args, do splits
+
+int main(int argc, char **argv)
+{
+	Reln r;  // handle on the open relation
+	char err[MAXERRMSG];  // buffer for error messages
+	int verbose = 0;  // show how many splits were done
+	Count max = ~0;  // most splits to do
+	char *rname;  // name of table/file
+	int opt;
+
+	// process command-line args
+
+	while ((opt = getopt(argc, argv, "+vn:")) != -1) {
+		switch (opt) {
+		case 'v': verbose = 1; break;
+		case 'n': max = atoi(optarg); break;
+		default:  fatal(USAGE);
+		}
+	}
+	if (optind >= argc) fatal(USAGE);
+	rname = argv[optind];
+
+	// open relation for writing, and split
+
+	if (!existsRelation(rname)) {
+		sprintf(err, "No such relation: %.100s", rname);
+		fatal(err);
+	}
+	if ((r = openRelation(rname, "r+")) == NULL) {
+		sprintf(err, "Can't open relation: %.100s", rname);
+		fatal(err);
+	}
+	Count done = paySplitDebt(r, max);
+	if (verbose)
+		printf("%d splits done, %d pending\n", done, splitDebt(r));
+	closeRelation(r);
+
+	return 0;
+}
@@ -1,22 +1,40 @@
 // stats.c ... show statistics for a Relation
 // part of Multi-attribute linear-hashed files
 // Show info and page stats for a Relation
-// Usage:  ./stats  RelName
+// Usage:  ./stats  [-n N | -b | -p]  RelName
+// Buckets are described from the relation's summary: the load factor,
+//   overflow ratio, chain lengths and the N (default 10) worst buckets
+// -b lists the summary of every bucket
+// -p lists every page in every bucket's chain (reading them all)
 
 #include "defs.h"
 #include "reln.h"
+#include <unistd.h>
 
-#define USAGE "./stats  RelName"
+#define USAGE "./stats  [-n N | -b | -p]  RelName"
 
 
 // Main ... process args, run query
 
 int main(int argc, char **argv)
 {
+	int ntop = 10;  // number of worst buckets to show
+	Bool all = FALSE;  // show every bucket's summary
+	Bool pages = FALSE;  // show every page
+	int opt;
+
 	// process command-line args
 
-	if (argc < 2) fatal(USAGE);
-	char *relname = argv[1];
+	while ((opt = getopt(argc, argv, "+n:bp")) != -1) {
+		switch (opt) {
+		case 'n': ntop = atoi(optarg); break;
+		case 'b': all = TRUE; break;
+		case 'p': pages = TRUE; break;
+		default:  fatal(USAGE);
+		}
+	}
+	if (optind >= argc || ntop < 0) fatal(USAGE);
+	char *relname = argv[optind];
 
 	// open relation and show stats
 
@@ -25,7 +43,7 @@ int main(int argc, char **argv)
 	Reln r = openRelation(relname,"r");
 	if (r == NULL) fatal("No such relation");
 
-	relationStats(r);
+	relationStats(r, ntop, all, pages);
 	closeRelation(r);
 
 	return 0;
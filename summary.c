@@ -0,0 +1,99 @@
+// summary.c ... summaries of the buckets of a relation
+// part of Multi-attribute Linear-hashed Files
+// A relation keeps the number of tuples, pages and free bytes in each
+//   bucket's chain up to date as tuples are inserted and buckets split,
+//   so that the stats command doesn't need to read every page
+// The summary file (R.sum) holds the number of buckets and of tuples
+//   when it was written, then a BucketSum for each bucket; if those
+//   counts don't match the relation's (e.g. it was written by an older
+//   version of the code), the summary is rebuilt from the pages
+
+#include "defs.h"
+#include "summary.h"
+
+struct SummaryRep {
+	Count n;        // number of buckets summarised
+	Count max;      // allocated size of b[]
+	BucketSum *b;   // summary of each bucket
+};
+
+// an empty summary
+
+Summary newSummary(void)
+{
+	Summary s = malloc(sizeof(struct SummaryRep));
+	assert(s != NULL);
+	s->n = 0; s->max = 64;
+	s->b = malloc(s->max*sizeof(BucketSum));
+	assert(s->b != NULL);
+	return s;
+}
+
+// read a relation's summary file
+// returns NULL if there's none, or it's not for nbuckets and ntups
+
+Summary loadSummary(char *name, Count nbuckets, Count ntups)
+{
+	char fname[MAXFILENAME];
+	sprintf(fname,"%s.sum",name);
+	FILE *f = fopen(fname,"r");
+	if (f == NULL) return NULL;
+	Count hdr[2];
+	if (fread(hdr, sizeof(Count), 2, f) != 2 ||
+	    hdr[0] != nbuckets || hdr[1] != ntups) {
+		fclose(f);
+		return NULL;
+	}
+	Summary s = newSummary();
+	bucketSum(s, nbuckets-1);
+	Count n = fread(s->b, sizeof(BucketSum), nbuckets, f);
+	fclose(f);
+	if (n != nbuckets) { freeSummary(s); return NULL; }
+	return s;
+}
+
+// write a relation's summary file
+
+void saveSummary(Summary s, char *name, Count ntups)
+{
+	char fname[MAXFILENAME];
+	sprintf(fname,"%s.sum",name);
+	FILE *f = fopen(fname,"w");
+	assert(f != NULL);
+	Count hdr[2] = { s->n, ntups };
+	Count n = fwrite(hdr, sizeof(Count), 2, f);
+	assert(n == 2);
+	n = fwrite(s->b, sizeof(BucketSum), s->n, f);
+	assert(n == s->n);
+	fclose(f);
+}
+
+void freeSummary(Summary s)
+{
+	free(s->b);
+	free(s);
+}
+
+// the summary of bucket b
+// the summary grows to cover b, with new buckets empty
+
+BucketSum *bucketSum(Summary s, PageID b)
+{
+	if (b >= s->max) {
+		while (b >= s->max) s->max *= 2;
+		s->b = realloc(s->b, s->max*sizeof(BucketSum));
+		assert(s->b != NULL);
+	}
+	while (s->n <= b) {
+		BucketSum *e = &s->b[s->n++];
+		e->ntups = e->npages = e->free = 0;
+	}
+	return &s->b[b];
+}
+
+// number of buckets summarised
+
+Count summaryBuckets(Summary s)
+{
+	return s->n;
+}
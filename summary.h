@@ -0,0 +1,26 @@
+// summary.h ... interface to bucket summaries
+// part of Multi-attribute Linear-hashed Files
+// See summary.c for details of Summary type and functions
+
+#ifndef SUMMARY_H
+#define SUMMARY_H 1
+
+typedef struct SummaryRep *Summary;
+
+#include "defs.h"
+
+// what's in a bucket's chain of pages
+typedef struct {
+	Count ntups;   // tuples
+	Count npages;  // pages (primary data page + overflow pages)
+	Count free;    // free bytes, over all of the pages
+} BucketSum;
+
+Summary newSummary(void);
+Summary loadSummary(char *name, Count nbuckets, Count ntups);
+void saveSummary(Summary s, char *name, Count ntups);
+void freeSummary(Summary s);
+BucketSum *bucketSum(Summary s, PageID b);
+Count summaryBuckets(Summary s);
+
+#endif
@@ -0,0 +1,191 @@
+// trace.c ... latency histograms and trace events
+// part of Multi-attribute Linear-hashed Files
+// If MALH_LATENCY is set (to "text" or "json"), the time taken by each
+//   insert, split, query set-up, next tuple, page read and page write
+//   is counted in a histogram for that operation, and the percentiles
+//   are printed on stderr when a relation is closed (or the process
+//   gets SIGUSR1), covering the operations since the last report
+// Each histogram has 8 slots per power of 2 of nanoseconds, so any
+//   latency is known to within 12.5%, in a fixed 2K bytes
+// If MALH_TRACE is set to a file name, each operation is also written
+//   to that file as a trace event (in the JSON format that chrome's
+//   about:tracing and Perfetto load), with its bucket or page id
+// If neither is set, an operation costs a test of a flag
+
+#include "defs.h"
+#include "trace.h"
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+
+#define SUBS   8                     // slots per power of 2
+#define NSLOTS (2*SUBS + 60*SUBS)    // enough for 2^63 ns
+
+static char *opName[NOPS] = {
+	"insert", "split", "query", "next", "read", "write"
+};
+// name of the id recorded with each operation's trace events
+static char *idName[NOPS] = {
+	"bucket", "bucket", NULL, "bucket", "page", "page"
+};
+
+static pthread_once_t started = PTHREAD_ONCE_INIT;
+static int tracing = 0;          // timing operations?
+static char *latency = NULL;     // report format, if keeping histograms
+static FILE *events = NULL;      // trace events file, if any
+static int nevents = 0;
+static long long t0;             // when tracing started
+static volatile sig_atomic_t reportWanted = 0;
+
+static Count hist[NOPS][NSLOTS];
+static long long maxns[NOPS];
+
+static long long nsecs(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec*1000000000LL + ts.tv_nsec;
+}
+
+static void onSignal(int sig)
+{
+	reportWanted = 1;
+}
+
+static void endEvents(void)
+{
+	fprintf(events, "\n]\n");
+	fclose(events);
+}
+
+// check the environment, the first time an operation is timed (by
+//   any thread)
+
+static void startTracing(void)
+{
+	latency = getenv("MALH_LATENCY");
+	if (latency != NULL) signal(SIGUSR1, onSignal);
+	char *fname = getenv("MALH_TRACE");
+	if (fname != NULL && (events = fopen(fname, "w")) != NULL) {
+		fprintf(events, "[\n");
+		atexit(endEvents);
+	}
+	tracing = (latency != NULL || events != NULL);
+	t0 = nsecs();
+}
+
+// slot for a latency of ns nanoseconds, and the largest latency in a slot
+
+static int slotOf(long long ns)
+{
+	if (ns < 2*SUBS) return ns;
+	int e = 63 - __builtin_clzll(ns);  // ns is in [2^e, 2^(e+1))
+	return 2*SUBS + (e-4)*SUBS + ((ns >> (e-3)) & (SUBS-1));
+}
+
+static long long slotMax(int s)
+{
+	if (s < 2*SUBS) return s;
+	int e = (s - 2*SUBS)/SUBS + 4;
+	return ((long long)(SUBS + 1 + (s - 2*SUBS)%SUBS) << (e-3)) - 1;
+}
+
+// the time an operation starts (0 if operations aren't being timed)
+
+long long traceStart(void)
+{
+	pthread_once(&started, startTracing);
+	return tracing ? nsecs() : 0;
+}
+
+// count an operation that started at start, on bucket or page id
+//   (NO_PAGE if none), and write its trace event
+
+void traceEnd(int op, long long start, Count id)
+{
+	if (start == 0) return;
+	long long ns = nsecs() - start;
+	// threads reading a shared relation may get here at once
+	if (latency != NULL) {
+		__atomic_fetch_add(&hist[op][slotOf(ns)], 1, __ATOMIC_RELAXED);
+		long long max = __atomic_load_n(&maxns[op], __ATOMIC_RELAXED);
+		while (ns > max && !__atomic_compare_exchange_n(&maxns[op], &max,
+		       ns, FALSE, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) ;
+	}
+	if (events != NULL) {
+		flockfile(events);
+		fprintf(events, "%s{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,"
+		        "\"dur\":%.3f,\"pid\":%d,\"tid\":%d",
+		        __atomic_fetch_add(&nevents, 1, __ATOMIC_RELAXED) > 0 ? ",\n" : "",
+		        opName[op], (start-t0)/1e3, ns/1e3, (int)getpid(),
+		        (int)syscall(SYS_gettid));
+		if (idName[op] != NULL && id != NO_PAGE)
+			fprintf(events, ",\"args\":{\"%s\":%u}", idName[op], id);
+		fputc('}', events);
+		funlockfile(events);
+	}
+	// just one thread reports, if several see the signal's flag
+	if (reportWanted && __atomic_exchange_n(&reportWanted, 0, __ATOMIC_RELAXED))
+		traceReport(latency, stderr);
+}
+
+// the latency (in microseconds) below which a fraction p of the n
+//   operations counted in histogram h fall, where max is the largest
+
+static double percentile(Count *h, Count n, long long max, double p)
+{
+	Count want = (Count)(p*n + 0.999), seen = 0;
+	for (int s = 0; s < NSLOTS; s++) {
+		seen += h[s];
+		if (seen >= want) {
+			long long ns = slotMax(s);
+			return (ns < max ? ns : max) / 1e3;
+		}
+	}
+	return max / 1e3;
+}
+
+// print the latency percentiles of each operation done since the last
+//   report, and start counting afresh
+// each count is taken and zeroed in one atomic exchange, so operations
+//   that other threads finish meanwhile go in this report or the next
+// format is "json" for a one-line JSON object, otherwise a table
+
+void traceReport(char *format, FILE *out)
+{
+	if (latency == NULL) return;
+	static double ps[] = { 0.5, 0.9, 0.99, 0.999 };
+	Bool json = (strcmp(format, "json") == 0);
+	if (json)
+		fprintf(out, "{");
+	else
+		fprintf(out, "%-8s %9s %9s %9s %9s %9s %9s  (usecs)\n", "op",
+		        "count", "p50", "p90", "p99", "p99.9", "max");
+	int n = 0;
+	for (int op = 0; op < NOPS; op++) {
+		Count h[NSLOTS], count = 0;
+		long long max = __atomic_exchange_n(&maxns[op], 0, __ATOMIC_RELAXED);
+		for (int s = 0; s < NSLOTS; s++) {
+			h[s] = __atomic_exchange_n(&hist[op][s], 0, __ATOMIC_RELAXED);
+			count += h[s];
+		}
+		if (count == 0) continue;
+		if (json) {
+			fprintf(out, "%s\"%s\":{\"count\":%u,\"p50_us\":%.3f,"
+			        "\"p90_us\":%.3f,\"p99_us\":%.3f,\"p999_us\":%.3f,"
+			        "\"max_us\":%.3f}", n++ > 0 ? "," : "", opName[op],
+			        count, percentile(h,count,max,ps[0]),
+			        percentile(h,count,max,ps[1]), percentile(h,count,max,ps[2]),
+			        percentile(h,count,max,ps[3]), max/1e3);
+		}
+		else {
+			fprintf(out, "%-8s %9u", opName[op], count);
+			for (int i = 0; i < 4; i++)
+				fprintf(out, " %9.2f", percentile(h,count,max,ps[i]));
+			fprintf(out, " %9.2f\n", max/1e3);
+		}
+	}
+	if (json) fprintf(out, "}\n");
+}
@@ -0,0 +1,23 @@
+// trace.h ... interface to latency histograms and trace events
+// part of Multi-attribute Linear-hashed Files
+// See trace.c for details of functions
+
+#ifndef TRACE_H
+#define TRACE_H 1
+
+#include "defs.h"
+
+// operations that are timed
+#define OP_INSERT 0   // adding a tuple to a relation
+#define OP_SPLIT  1   // splitting a bucket
+#define OP_QUERY  2   // setting up a query
+#define OP_NEXT   3   // finding a query's next matching tuple
+#define OP_READ   4   // reading a page
+#define OP_WRITE  5   // writing a page
+#define NOPS      6
+
+long long traceStart(void);
+void traceEnd(int op, long long start, Count id);
+void traceReport(char *format, FILE *out);
+
+#endif
@@ -9,6 +9,10 @@
 #include "chvec.h"
 #include "bits.h"
 #include "util.h"
+#include "dict.h"
+#include "heap.h"
+#include <errno.h>
+#include <limits.h>
 
 
 // return number of bytes/chars in a tuple
@@ -18,127 +22,157 @@ int tupLength(Tuple t)
 	return strlen(t);
 }
 
-// reads/parses next tuple in input
+// reads/parses next tuple in input, into arena a, and sets *t to it
+// returns READ_OK, READ_EOF if there's no more input, or READ_BAD if
+//   the line isn't a valid tuple (the last line needn't end in a
+//   newline, but it's checked like any other)
+// a line that's too long is skipped, and treated as invalid; only
+//   RELN_OUTOFLINE relations take tuples longer than MAXTUPLEN
 
-Tuple readTuple(Reln r, FILE *in)
+int readTuple(Reln r, FILE *in, Arena a, Tuple *t)
 {
-	char line[MAXTUPLEN];
-	if (fgets(line, MAXTUPLEN-1, in) == NULL)
-		return NULL;
-	line[strlen(line)-1] = '\0';
+	char line[MAXLINE];
+	*t = NULL;
+	if (fgets(line, MAXLINE, in) == NULL)
+		return ferror(in) ? READ_BAD : READ_EOF;
+	int len = strlen(line);
+	if (len > 0 && line[len-1] == '\n')
+		line[--len] = '\0';
+	else if (!feof(in)) {
+		int ch;
+		while ((ch = getc(in)) != '\n' && ch != EOF) ;
+		return READ_BAD;
+	}
+	if (len >= MAXTUPLEN && !(relnFlags(r) & RELN_OUTOFLINE))
+		return READ_BAD;
 	// count fields
 	// cheap'n'nasty parsing
 	char *c; int nf = 1;
 	for (c = line; *c != '\0'; c++)
 		if (*c == ',') nf++;
 	// invalid tuple
-	if (nf != nattrs(r)) return NULL;
-	return copyString(line); // needs to be free'd sometime
+	if (nf != nattrs(r)) return READ_BAD;
+	if (isEncoded(r)) {
+		// integer attributes must hold integers
+		char *vals[MAXATTRS];
+		Bool ok = TRUE;
+		tupleVals(line, vals, a);
+		for (int i = 0; i < nf; i++) {
+			long long v;
+			Byte enc = attrEncoding(r,i);
+			if (fieldWidth(enc) > 0 && parseInt(enc, vals[i], &v) != OK)
+				ok = FALSE;
+		}
+		if (!ok) return READ_BAD;
+	}
+	*t = arenaString(a, line);
+	return READ_OK;
+}
+
+// parse the value of an integer attribute into *v
+// returns OK, or ~OK if val isn't a decimal integer in range
+
+Status parseInt(Byte enc, char *val, long long *v)
+{
+	char *end;
+	errno = 0;
+	*v = strtoll(val, &end, 10);
+	if (end == val || *end != '\0' || errno == ERANGE) return ~OK;
+	if (enc == ATT_INT32 && (*v < INT_MIN || *v > INT_MAX)) return ~OK;
+	return OK;
+}
+
+// hash of a value of attribute i
+// integers are hashed by value, so "7" and "007" hash alike
+
+Bits attrHash(Reln r, int i, char *val)
+{
+	long long v;
+	Byte enc = attrEncoding(r,i);
+	relnCount(r, CNT_HASH, 1);
+	if (fieldWidth(enc) > 0 && parseInt(enc, val, &v) == OK)
+		return hash_int(v);
+	return hash_any((unsigned char *)val,strlen(val));
 }
 
 // extract values into an array of strings
+// the values are in a copy of the tuple, allocated in arena a
 
-void tupleVals(Tuple t, char **vals)
+void tupleVals(Tuple t, char **vals, Arena a)
 {
-	char *c = t, *c0 = t;
+	char *c = arenaString(a, t), *c0 = c;
 	int i = 0;
 	for (;;) {
 		while (*c != ',' && *c != '\0') c++;
 		if (*c == '\0') {
 			// end of tuple; add last field to vals
-			vals[i++] = copyString(c0);
+			vals[i++] = c0;
 			break;
 		}
 		else {
 			// end of next field; add to vals
 			*c = '\0';
-			vals[i++] = copyString(c0);
-			*c = ',';
+			vals[i++] = c0;
 			c++; c0 = c;
 		}
 	}
 }
 
-// release memory used for separate attirubte values
+// combine per-attribute hashes into a tuple hash,
+//  using the choice vector to pick bits
 
-void freeVals(char **vals, int nattrs)
+static Bits combineHashes(Reln r, Bits *hashs)
 {
-	int i;
-	for (i = 0; i < nattrs; i++) free(vals[i]);
+    ChVecItem *cv = chvec(r);
+    Bits hash = 0;
+    for(int i = 0;i< MAXCHVEC;i++){
+        if(bitIsSet(hashs[cv[i].att],cv[i].bit)){
+            hash = setBit(hash,i);
+        }
+    }
+    return hash;
 }
 
-// hash a tuple using the choice vector
-// TODO: actually use the choice vector to make the hash
+// hash a tuple using the choice vector, leaving the hash of each of
+//   its attributes in hashs
 
-Bits tupleHash(Reln r, Tuple t)
+static Bits tupleAttrHashes(Reln r, Tuple t, Bits *hashs)
 {
-    int att,bit;
-    ChVecItem *cv = chvec(r);
     Count nvals = nattrs(r);
-    Bits hashs[nvals];
-    char **vals = malloc(nvals*sizeof(char *));
-    tupleVals(t, vals);
+    char *vals[MAXATTRS];
+    tupleVals(t, vals, relnArena(r));
 
     for(int i= 0;i < nvals;i++) {
-        hashs[i] = hash_any((unsigned char *)vals[i],strlen(vals[i]));
-    }
-    Bits hash = 0;
-    for(int i = 0;i< MAXCHVEC;i++){
-        att = cv[i].att;
-        bit = cv[i].bit;
-        if(bitIsSet(hashs[att],bit)){
-            hash = setBit(hash,i);
-        }
+        hashs[i] = attrHash(r,i,vals[i]);
     }
+	return combineHashes(r,hashs);
+}
 
-    char buf[MAXBITS+1];
+// hash a tuple, and show the hash (and leave attribute hashes in hashs)
+
+Bits tupleHash(Reln r, Tuple t, Bits *hashs)
+{
+    Bits hash = tupleAttrHashes(r,t,hashs);
+    char buf[MAXBITS+5];
     bitsString(hash,buf);
     printf("hash(%s) = %s\n",t,buf);
-    for(int i= 0;i < nvals;i++) {
-        free(vals[i]);
-    }
-    free(vals);
 	return hash;
 }
 
 Bits tupleHashNoPrint(Reln r, Tuple t)
 {
-    int att,bit;
-    ChVecItem *cv = chvec(r);
-    Count nvals = nattrs(r);
-    Bits hashs[nvals];
-    char **vals = malloc(nvals*sizeof(char *));
-    tupleVals(t, vals);
-
-    for(int i= 0;i < nvals;i++) {
-        hashs[i] = hash_any((unsigned char *)vals[i],strlen(vals[i]));
-    }
-    Bits hash = 0;
-    for(int i = 0;i< MAXCHVEC;i++){
-        att = cv[i].att;
-        bit = cv[i].bit;
-        if(bitIsSet(hashs[att],bit)){
-            hash = setBit(hash,i);
-        }
-    }
-    for(int i= 0;i < nvals;i++) {
-        free(vals[i]);
-    }
-    free(vals);
-	return hash;
+    Bits hashs[MAXATTRS];
+    return tupleAttrHashes(r,t,hashs);
 }
 
-
-
 // compare two tuples (allowing for "unknown" values)
 
 Bool tupleMatch(Reln r, Tuple t1, Tuple t2)
 {
 	Count na = nattrs(r);
-	char **v1 = malloc(na*sizeof(char *));
-	tupleVals(t1, v1);
-	char **v2 = malloc(na*sizeof(char *));
-	tupleVals(t2, v2);
+	char *v1[MAXATTRS], *v2[MAXATTRS];
+	tupleVals(t1, v1, relnArena(r));
+	tupleVals(t2, v2, relnArena(r));
 	Bool match = TRUE;
 	int i;
 	for (i = 0; i < na; i++) {
@@ -147,7 +181,6 @@ Bool tupleMatch(Reln r, Tuple t1, Tuple t2)
 		if (strcmp(v1[i],v2[i]) == 0) continue;
 		match = FALSE;
 	}
-	freeVals(v1,na); freeVals(v2,na);
 	return match;
 }
 
@@ -157,3 +190,322 @@ void tupleString(Tuple t, char *buf)
 {
 	strcpy(buf,t);
 }
+
+// Tuples are stored in pages as records, in one of two formats; the
+//   relation's version (see reln.c) says which
+// Version 1 (relations from before versions, and PAX relations):
+//   If all of a relation's attributes are plain text, a record is just
+//   the tuple string "v1,v2,...,vn" and its terminating '\0'
+//   Otherwise (isEncoded(r)), each attribute is stored as a field:
+//     ATT_TEXT: the value followed by '\0', or in a RELN_OUTOFLINE
+//       relation, a reference to a long value in the value heap
+//       (a '\0'-terminated field starting with HEAPREF; see heap.c)
+//     ATT_DICT: the value's id in the relation's dictionary, as a varint
+//     ATT_INT32, ATT_INT64: the value in binary, 4 or 8 bytes
+//   Field boundaries are found by stepping through fields in order
+//   In RELN_PAX relations, records are always in field form, and pages
+//     store each field in its attribute's minipage (see page.c)
+// Version 2 (row layout):
+//   A header with the length of each attribute's field (1 byte each),
+//   followed by the fields, encoded as for version 1 but without
+//   terminators (a heap reference is REFLEN-1 bytes)
+//   Field i is located from the header alone, without looking at the
+//   values, and values may contain any bytes
+
+// width of fields with a fixed-width encoding (0 for others)
+
+Count fieldWidth(Byte enc)
+{
+	switch (enc) {
+	case ATT_INT32: return sizeof(int);
+	case ATT_INT64: return sizeof(long long);
+	default:        return 0;
+	}
+}
+
+// store integer v as a field with encoding enc; returns its width
+
+Count putIntField(Byte enc, long long v, char *f)
+{
+	if (enc == ATT_INT32) {
+		int i = v;
+		memcpy(f, &i, sizeof(i));
+		return sizeof(i);
+	}
+	memcpy(f, &v, sizeof(v));
+	return sizeof(v);
+}
+
+// value of the integer field at f, with encoding enc
+
+long long getIntField(Byte enc, char *f)
+{
+	if (enc == ATT_INT32) {
+		int i;
+		memcpy(&i, f, sizeof(i));
+		return i;
+	}
+	long long v;
+	memcpy(&v, f, sizeof(v));
+	return v;
+}
+
+// is the field of len bytes at f a reference to a value in the
+//   value heap? (values that look like one are stored out of line)
+
+Bool isHeapRef(Reln r, char *f, Count len)
+{
+	return (relnFlags(r) & RELN_OUTOFLINE) && len == REFLEN-1 &&
+	       f[0] == HEAPREF;
+}
+
+// convert a tuple into record form in rec; return record length
+
+Count tupleToRecord(Reln r, Tuple t, char *rec)
+{
+	if (!isEncoded(r)) {
+		strcpy(rec, t);
+		return strlen(t)+1;
+	}
+	Count na = nattrs(r);
+	Bool v2 = relnVersion(r) >= 2;
+	char *vals[MAXATTRS];
+	tupleVals(t, vals, relnArena(r));
+	char *c = rec;
+	if (v2) c += na;  // header is filled in as fields are added
+	for (int i = 0; i < na; i++) {
+		char *f = c;
+		Count len = strlen(vals[i]);
+		if (attrEncoding(r,i) == ATT_DICT) {
+			Count id = dictIntern(relnDict(r), i, vals[i]);
+			c += putVarint(id, c);
+		}
+		else if (fieldWidth(attrEncoding(r,i)) > 0) {
+			long long v = 0;
+			parseInt(attrEncoding(r,i), vals[i], &v);
+			c += putIntField(attrEncoding(r,i), v, c);
+		}
+		else if ((relnFlags(r) & RELN_OUTOFLINE) && outOfLine(vals[i], len)) {
+			Bits h = hash_any((unsigned char *)vals[i], len);
+			relnCount(r, CNT_HASH, 1);
+			c += heapPut(relnHeap(r), vals[i], len, h, c);
+			if (v2) c--;  // no terminator
+		}
+		else {
+			memcpy(c, vals[i], len);
+			c += len;
+			if (!v2) *c++ = '\0';
+		}
+		if (v2) {
+			assert(c - f < 256);
+			rec[i] = (char)(c - f);
+		}
+	}
+	return c - rec;
+}
+
+// step over field i of a version 1 record, where f is the start of
+//   the field; returns the start of the following field; for text
+//   fields, the value's length is (next - f - 1), excluding its terminator
+
+char *skipField(Reln r, char *f, int i)
+{
+	if (!isEncoded(r)) {
+		while (*f != ',' && *f != '\0') f++;
+		return f+1;
+	}
+	Byte enc = attrEncoding(r,i);
+	if (enc == ATT_DICT) {
+		while (*f & 0x80) f++;
+		return f+1;
+	}
+	if (fieldWidth(enc) > 0) return f + fieldWidth(enc);
+	return f + strlen(f) + 1;
+}
+
+// locate the fields of the record at rec: attribute i's field is the
+//   lens[i] bytes at fields[i] (not counting any terminator)
+// returns the length of the record
+
+Count recordFields(Reln r, char *rec, char **fields, Count *lens)
+{
+	Count na = nattrs(r);
+	char *f;
+	if (relnVersion(r) >= 2) {
+		f = rec + na;
+		for (int i = 0; i < na; i++) {
+			fields[i] = f;
+			lens[i] = (Byte)rec[i];
+			f += lens[i];
+		}
+		return f - rec;
+	}
+	f = rec;
+	for (int i = 0; i < na; i++) {
+		char *next = skipField(r, f, i);
+		fields[i] = f;
+		lens[i] = next - f;
+		if (!isEncoded(r) || attrEncoding(r,i) == ATT_TEXT) lens[i]--;
+		f = next;
+	}
+	return f - rec;
+}
+
+// number of bytes occupied by the record at rec
+
+Count recordLength(Reln r, char *rec)
+{
+	if (!isEncoded(r)) return strlen(rec)+1;
+	char *fields[MAXATTRS];
+	Count lens[MAXATTRS];
+	return recordFields(r, rec, fields, lens);
+}
+
+// convert a record back into printable tuple form in buf
+
+void recordToTuple(Reln r, char *rec, char *buf)
+{
+	if (!isEncoded(r)) {
+		strcpy(buf, rec);
+		return;
+	}
+	char *fields[MAXATTRS];
+	Count lens[MAXATTRS];
+	recordFields(r, rec, fields, lens);
+	char *c = buf;
+	for (int i = 0; i < nattrs(r); i++) {
+		if (i > 0) *c++ = ',';
+		c += fieldValue(r, i, fields[i], lens[i], c);
+	}
+	*c = '\0';
+}
+
+// put the printable value of attribute i, from its field of len bytes
+//   at f, in buf; returns the value's length
+
+Count fieldValue(Reln r, int i, char *f, Count len, char *buf)
+{
+	Byte enc = attrEncoding(r,i);
+	if (enc == ATT_DICT) {
+		Count id;
+		getVarint(f, &id);
+		strcpy(buf, dictValue(relnDict(r), i, id));
+	}
+	else if (fieldWidth(enc) > 0)
+		sprintf(buf, "%lld", getIntField(enc, f));
+	else if (isHeapRef(r, f, len))
+		heapGet(relnHeap(r), f, buf);
+	else {
+		memcpy(buf, f, len);
+		buf[len] = '\0';
+	}
+	return strlen(buf);
+}
+
+// hash of attribute i's value, from its field of len bytes at f
+// (same as attrHash on the value); uses stored hashes where there
+//   are any: dictionary values' hashes are kept in the dictionary,
+//   and long values' hashes in their references
+
+Bits fieldHash(Reln r, int i, char *f, Count len)
+{
+	if (attrEncoding(r,i) == ATT_DICT) {
+		Count id;
+		getVarint(f, &id);
+		return dictHash(relnDict(r), i, id);
+	}
+	if (fieldWidth(attrEncoding(r,i)) > 0) {
+		relnCount(r, CNT_HASH, 1);
+		return hash_int(getIntField(attrEncoding(r,i), f));
+	}
+	if (isHeapRef(r, f, len)) {
+		Bits h; Count vlen;
+		heapRefInfo(f, &h, &vlen);
+		return h;
+	}
+	relnCount(r, CNT_HASH, 1);
+	return hash_any((unsigned char *)f, len);
+}
+
+// hash of the tuple in a record (same as tupleHashNoPrint)
+
+Bits recordHash(Reln r, char *rec)
+{
+	if (!isEncoded(r)) return tupleHashNoPrint(r, rec);
+	Count na = nattrs(r);
+	Bits hashs[na];
+	char *fields[MAXATTRS];
+	Count lens[MAXATTRS];
+	recordFields(r, rec, fields, lens);
+	for (int i = 0; i < na; i++)
+		hashs[i] = fieldHash(r, i, fields[i], lens[i]);
+	return combineHashes(r,hashs);
+}
+
+// hash of attribute i's value in a record (same as attrHash)
+
+Bits recordAttrHash(Reln r, char *rec, int i)
+{
+	char *fields[MAXATTRS];
+	Count lens[MAXATTRS];
+	recordFields(r, rec, fields, lens);
+	return fieldHash(r, i, fields[i], lens[i]);
+}
+
+// add a record of len bytes to a page, in the relation's page layout
+// returns OK, or -1 if there's not enough room
+
+Status addRecord(Reln r, Page p, char *rec, Count len)
+{
+	if (!(relnFlags(r) & RELN_PAX)) return addToPage(p, rec, len);
+	Count na = nattrs(r);
+	char *fields[MAXATTRS];
+	Count lens[MAXATTRS];
+	char *f = rec;
+	for (int i = 0; i < na; i++) {
+		char *next = skipField(r, f, i);
+		fields[i] = f;
+		lens[i] = next - f;
+		f = next;
+	}
+	return addFieldsToPage(p, na, fields, lens);
+}
+
+// set up a scan through the records of page p
+
+void startRecScan(Reln r, Page p, RecScan *s)
+{
+	s->page = p;
+	s->next = 0;
+	s->cur = pageData(p);
+	if (relnFlags(r) & RELN_PAX) {
+		Count size;
+		for (int i = 0; i < nattrs(r); i++)
+			s->field[i] = pageMinipage(p, nattrs(r), i, &size);
+	}
+}
+
+// next record in a scan (NULL if none), with its length in *len
+// in a PAX page, the record is assembled from the minipages, and
+//   is only valid until the next call
+
+char *nextRecord(Reln r, RecScan *s, Count *len)
+{
+	if (s->next >= pageNTuples(s->page)) return NULL;
+	s->next++;
+	if (!(relnFlags(r) & RELN_PAX)) {
+		char *rec = s->cur;
+		*len = recordLength(r, rec);
+		s->cur += *len;
+		return rec;
+	}
+	char *c = s->rec;
+	for (int i = 0; i < nattrs(r); i++) {
+		char *next = skipField(r, s->field[i], i);
+		memcpy(c, s->field[i], next - s->field[i]);
+		c += next - s->field[i];
+		s->field[i] = next;
+	}
+	*len = c - s->rec;
+	return s->rec;
+}
@@ -2,6 +2,7 @@
 // part of Multi-attribute Linear-hashed Files
 // A Tuple is just a '\0'-terminated C string
 // Consists of "val_1,val_2,val_3,...,val_n"
+// Tuples are stored in pages as records (see tuple.c)
 // See tuple.c for details on functions
 
 #ifndef TUPLE_H
@@ -10,15 +11,48 @@
 typedef char *Tuple;
 
 #include "reln.h"
+#include "page.h"
 #include "bits.h"
+#include "arena.h"
+
+// state of a scan through the records in a page (see nextRecord)
+typedef struct {
+	Page   page;
+	Count  next;            // index of next record
+	char  *cur;             // row layout: next record in page
+	char  *field[MAXATTRS]; // PAX layout: next field of each minipage
+	char   rec[MAXRECLEN];  // PAX layout: record assembled from fields
+} RecScan;
+
+// results of readTuple
+#define READ_OK  0   // a valid tuple was read
+#define READ_EOF 1   // end of input, with nothing more read
+#define READ_BAD 2   // the line read wasn't a valid tuple
 
 int tupLength(Tuple t);
-Tuple readTuple(Reln r, FILE *in);
-Bits tupleHash(Reln r, Tuple t);
+int readTuple(Reln r, FILE *in, Arena a, Tuple *t);
+Status parseInt(Byte enc, char *val, long long *v);
+Bits attrHash(Reln r, int i, char *val);
+Bits tupleHash(Reln r, Tuple t, Bits *hashs);
 Bits tupleHashNoPrint(Reln r, Tuple t);
-void tupleVals(Tuple t, char **vals);
-void freeVals(char **vals, int nattrs);
+void tupleVals(Tuple t, char **vals, Arena a);
 Bool tupleMatch(Reln r, Tuple t1, Tuple t2);
 void tupleString(Tuple t, char *buf);
+Count fieldWidth(Byte enc);
+Count putIntField(Byte enc, long long v, char *f);
+long long getIntField(Byte enc, char *f);
+Bool isHeapRef(Reln r, char *f, Count len);
+Count tupleToRecord(Reln r, Tuple t, char *rec);
+Count recordLength(Reln r, char *rec);
+char *skipField(Reln r, char *f, int i);
+Count recordFields(Reln r, char *rec, char **fields, Count *lens);
+void recordToTuple(Reln r, char *rec, char *buf);
+Count fieldValue(Reln r, int i, char *f, Count len, char *buf);
+Bits recordHash(Reln r, char *rec);
+Bits recordAttrHash(Reln r, char *rec, int i);
+Bits fieldHash(Reln r, int i, char *f, Count len);
+Status addRecord(Reln r, Page p, char *rec, Count len);
+void startRecScan(Reln r, Page p, RecScan *s);
+char *nextRecord(Reln r, RecScan *s, Count *len);
 
 #endif
@@ -19,3 +19,32 @@ char *copyString(char *str)
 	strcpy(new, str);
 	return new;
 }
+
+// write v as a varint (7 bits per byte, high bit set on all
+//   but the last byte) into buf; return number of bytes used
+
+int putVarint(unsigned int v, char *buf)
+{
+	int n = 0;
+	while (v >= 0x80) {
+		buf[n++] = (char)(v | 0x80);
+		v >>= 7;
+	}
+	buf[n++] = (char)v;
+	return n;
+}
+
+// read a varint from buf into *v; return number of bytes used
+
+int getVarint(char *buf, unsigned int *v)
+{
+	unsigned char *b = (unsigned char *)buf;
+	unsigned int val = 0;
+	int n = 0, shift = 0;
+	do {
+		val |= (unsigned int)(b[n] & 0x7f) << shift;
+		shift += 7;
+	} while (b[n++] & 0x80);
+	*v = val;
+	return n;
+}
@@ -6,5 +6,7 @@
 
 void fatal(char *);
 char *copyString(char *);
+int putVarint(unsigned int, char *);
+int getVarint(char *, unsigned int *);
 
 #endif